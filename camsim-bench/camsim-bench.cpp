@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2018
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <QGuiApplication>
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QFile>
+
+#include <cstdio>
+#include <cmath>
+
+#include <camsim/camsim.hpp>
+
+/* This program runs a fixed set of simulation configurations and reports
+ * frames per second, GPU time per pass, peak texture memory, and export
+ * throughput for each of them as JSON, so that performance regressions can be
+ * detected by comparing the results of different builds.
+ *
+ * The Crytek Sponza model (http://casual-effects.com/data/) is used if its
+ * path is given with --sponza; this requires libcamsim to be built with ASSIMP.
+ */
+
+typedef enum {
+    ModeRGB,            // plain RGB simulation
+    ModeShadowMaps,     // RGB with filtered shadow maps
+    ModeRSM,            // RGB with shadow maps and reflective shadow maps
+    ModePMD             // PMD with spatial and temporal oversampling and shadow maps
+} Mode;
+
+static const char* modeName(Mode mode)
+{
+    switch (mode) {
+    case ModeRGB:
+        return "rgb";
+    case ModeShadowMaps:
+        return "shadowmaps";
+    case ModeRSM:
+        return "rsm";
+    case ModePMD:
+        return "pmd";
+    }
+    return "";
+}
+
+class Configuration
+{
+public:
+    QString sceneName;
+    QSize resolution;
+    int lights;
+    Mode mode;
+};
+
+// Create the geometry and materials of a scene. This is done only once per scene, and the
+// configurations share the result, so that they all run with the same GPU memory state.
+static bool createSceneGeometry(CamSim::Scene& scene, const QString& sceneName,
+        const QString& sponzaFileName)
+{
+    CamSim::Generator generator;
+
+    if (sceneName == "sponza") {
+        CamSim::Importer importer;
+        if (!importer.import(sponzaFileName))
+            return false;
+        QMatrix4x4 M;
+        M.translate(0.0f, -1.7f, 0.0f);
+        M.rotate(90.0f, 0.0f, 1.0f, 0.0f);
+        M.scale(0.01f, 0.01f, 0.01f);
+        importer.setTransformationMatrix(M);
+        importer.addObjectToScene(scene);
+    } else {
+        // A model in a box, rotating so that shadow maps need to be updated in each frame
+        CamSim::Material boxMaterial;
+        boxMaterial.isTwoSided = true;
+        boxMaterial.diffuse = QVector3D(0.5f, 0.5f, 0.5f);
+        boxMaterial.specular = QVector3D(0.0f, 0.0f, 0.0f);
+        int boxMaterialIndex = scene.addMaterial(boxMaterial);
+        CamSim::Transformation boxTransformation;
+        boxTransformation.translation = QVector3D(0.0f, 0.0f, -2.0f);
+        boxTransformation.scaling = QVector3D(2.0f, 2.0f, 2.0f);
+        generator.addCubeToScene(scene, boxMaterialIndex, boxTransformation);
+
+        CamSim::Material modelMaterial;
+        modelMaterial.diffuse = QVector3D(0.6f, 0.6f, 0.6f);
+        modelMaterial.specular = QVector3D(0.3f, 0.3f, 0.3f);
+        modelMaterial.shininess = 100.0f;
+        int modelMaterialIndex = scene.addMaterial(modelMaterial);
+        CamSim::Animation modelAnimation;
+        for (int i = 0; i <= 4; i++) {
+            CamSim::Transformation modelAnimationTransformation;
+            modelAnimationTransformation.translation = QVector3D(0.0f, 0.0f, -2.0f);
+            modelAnimationTransformation.rotation = QQuaternion::fromAxisAndAngle(0.0f, 1.0f, 0.0f, i * 90.0f);
+            modelAnimation.addKeyframe(i * 1250000, modelAnimationTransformation);
+        }
+        CamSim::Transformation modelTransformation;
+        modelTransformation.scaling = QVector3D(0.8f, 0.8f, 0.8f);
+        if (sceneName == "bunny")
+            generator.addBunnyToScene(scene, modelMaterialIndex, modelTransformation, modelAnimation);
+        else if (sceneName == "dragon")
+            generator.addDragonToScene(scene, modelMaterialIndex, modelTransformation, modelAnimation);
+        else
+            generator.addBuddhaToScene(scene, modelMaterialIndex, modelTransformation, modelAnimation);
+    }
+    return true;
+}
+
+// Add light sources on a ring around the viewing direction
+static void addLights(CamSim::Scene& scene, int lights)
+{
+    for (int l = 0; l < lights; l++) {
+        float angle = l * 2.0f * static_cast<float>(M_PI) / lights;
+        CamSim::Light light;
+        light.type = CamSim::PointLight;
+        light.position = QVector3D(0.8f * std::cos(angle), 0.8f * std::sin(angle), -0.5f);
+        light.color = QVector3D(2.0f, 2.0f, 2.0f) / lights;   // for RGB simulation
+        light.power = 0.2f / lights;                          // for PMD simulation
+        light.shadowMapSize = 512;
+        light.shadowMapDepthBias = 0.05;
+        light.reflectiveShadowMapSize = 128;
+        scene.addLight(light);
+    }
+}
+
+static void setupSimulator(CamSim::Simulator& simulator, const Configuration& conf)
+{
+    CamSim::Projection projection = CamSim::Projection::fromOpeningAngle(
+            conf.resolution.width(), conf.resolution.height(), 70.0f);
+
+    CamSim::Pipeline pipeline;
+    pipeline.transparency = (conf.sceneName == "sponza");
+    pipeline.shadowMaps = (conf.mode != ModeRGB);
+    pipeline.shadowMapFiltering = (conf.mode != ModeRGB);
+    pipeline.reflectiveShadowMaps = (conf.mode == ModeRSM);
+    if (conf.mode == ModePMD) {
+        pipeline.spatialSamples = QSize(3, 3);
+        pipeline.temporalSamples = 8;
+        pipeline.shotNoise = true;
+    }
+
+    CamSim::Output output;
+    output.rgb = (conf.mode != ModePMD);
+    output.srgb = (conf.mode != ModePMD);
+    output.pmd = (conf.mode == ModePMD);
+
+    simulator.setProjection(projection);
+    simulator.setChipTiming(CamSim::ChipTiming::fromSubFramesPerSecond(100.0f));
+    simulator.setPipeline(pipeline);
+    simulator.setOutput(output);
+}
+
+static QJsonObject runConfiguration(const Configuration& conf, const CamSim::Scene& scene,
+        int frames, const QString& exportDir)
+{
+    QJsonObject result;
+    result["scene"] = conf.sceneName;
+    result["width"] = conf.resolution.width();
+    result["height"] = conf.resolution.height();
+    result["lights"] = conf.lights;
+    result["mode"] = QString(modeName(conf.mode));
+
+    CamSim::Simulator simulator;
+    simulator.setScene(scene);
+    setupSimulator(simulator, conf);
+    simulator.setGpuTiming(true);
+
+    // Use fixed frame timestamps so that all runs simulate the same frames.
+    // The first frames are only for warm-up (shader compilation, texture uploads).
+    const int warmupFrames = 3;
+    QVector<long long> timestamps(warmupFrames + frames);
+    for (int i = 0; i < timestamps.size(); i++)
+        timestamps[i] = i * simulator.frameDuration();
+    QVector<long long> warmupTimestamps = timestamps.mid(0, warmupFrames);
+    QVector<long long> benchTimestamps = timestamps.mid(warmupFrames);
+
+    CamSim::TexData data;
+    auto retrieve = [&](int, long long) {
+        return QList<CamSim::TexDataFuture>()
+            << (conf.mode == ModePMD ? simulator.getPMDAsync() : simulator.getSRGBAsync());
+    };
+    auto keep = [&](int, long long, const QList<CamSim::TexData>& results) {
+        data = results[0];
+    };
+    simulator.simulateBatch(warmupTimestamps, retrieve, keep);
+    simulator.resetStatistics();
+
+    QElapsedTimer timer;
+    timer.start();
+    simulator.simulateBatch(benchTimestamps, retrieve, keep);
+    qint64 simulationTime = timer.nsecsElapsed();
+
+    // Export the last result once per frame into a sequence file
+    QString exportFileName = exportDir + '/' + (conf.mode == ModePMD ? "export.pfs" : "export.ppm");
+    QFile::remove(exportFileName);
+    CamSim::Exporter exporter;
+    timer.restart();
+    for (int i = 0; i < frames; i++)
+        exporter.asyncExportData(exportFileName, data);
+    bool exportOk = exporter.waitForAsyncExports();
+    qint64 exportTime = timer.nsecsElapsed();
+    QFile::remove(exportFileName);
+
+    const CamSim::Statistics& statistics = simulator.statistics();
+    result["frames"] = frames;
+    result["frames_per_second"] = frames / (simulationTime * 1e-9);
+    result["peak_texture_memory_bytes"] = static_cast<double>(simulator.peakTextureMemory());
+    if (exportOk)
+        result["export_megabytes_per_second"] = frames * data.packedDataSize() / (exportTime * 1e-9) / 1e6;
+    else
+        result["export_megabytes_per_second"] = QJsonValue();
+    result["statistics"] = QJsonDocument::fromJson(statistics.toJSON().toUtf8()).object();
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    /* Initialize Qt and an OpenGL context. The backend can be selected with
+     * CAMSIM_CONTEXT_BACKEND=egl (and CAMSIM_EGL_DEVICE) on GPU servers. */
+    if (!CamSim::Context::initializeBackend())
+        return 1;
+    QGuiApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmark CamSim with a fixed set of configurations.");
+    parser.addHelpOption();
+    QCommandLineOption framesOption("frames", "Number of frames per configuration (default 50).", "n", "50");
+    QCommandLineOption sponzaOption("sponza", "Path to the Crytek Sponza model (sponza.obj).", "file");
+    QCommandLineOption outputOption("output", "Write the JSON result to this file instead of standard output.", "file");
+    QCommandLineOption quickOption("quick", "Only run the smallest resolution and a single light source.");
+    parser.addOption(framesOption);
+    parser.addOption(sponzaOption);
+    parser.addOption(outputOption);
+    parser.addOption(quickOption);
+    parser.process(app);
+    int frames = parser.value(framesOption).toInt();
+    if (frames < 1) {
+        qCritical("Invalid number of frames");
+        return 1;
+    }
+    QString sponzaFileName = parser.value(sponzaOption);
+    QTemporaryDir exportDir;
+    if (!exportDir.isValid()) {
+        qCritical("Cannot create temporary directory for exports");
+        return 1;
+    }
+    CamSim::Context context;
+
+    /* Build the list of configurations */
+    QList<QString> sceneNames = { "bunny", "dragon", "buddha" };
+    if (!sponzaFileName.isEmpty())
+        sceneNames.append("sponza");
+    QList<QSize> resolutions = { QSize(320, 240), QSize(640, 480), QSize(1280, 960) };
+    QList<int> lightCounts = { 1, 4 };
+    if (parser.isSet(quickOption)) {
+        resolutions = { resolutions.first() };
+        lightCounts = { lightCounts.first() };
+    }
+    QList<Mode> modes = { ModeRGB, ModeShadowMaps, ModeRSM, ModePMD };
+    QList<Configuration> configurations;
+    for (const QString& sceneName : sceneNames) {
+        for (const QSize& resolution : resolutions) {
+            for (int lights : lightCounts) {
+                for (Mode mode : modes) {
+                    Configuration conf;
+                    conf.sceneName = sceneName;
+                    conf.resolution = resolution;
+                    conf.lights = lights;
+                    conf.mode = mode;
+                    configurations.append(conf);
+                }
+            }
+        }
+    }
+
+    /* Run them */
+    QJsonArray results;
+    QString geometrySceneName;
+    CamSim::Scene geometryScene;
+    bool geometryOk = false;
+    for (int i = 0; i < configurations.size(); i++) {
+        const Configuration& conf = configurations[i];
+        qInfo("%d/%d: %s %dx%d, %d light(s), %s", i + 1, configurations.size(),
+                qPrintable(conf.sceneName), conf.resolution.width(), conf.resolution.height(),
+                conf.lights, modeName(conf.mode));
+        if (conf.sceneName != geometrySceneName) {
+            geometrySceneName = conf.sceneName;
+            geometryScene = CamSim::Scene();
+            geometryOk = createSceneGeometry(geometryScene, conf.sceneName, sponzaFileName);
+        }
+        if (!geometryOk) {
+            QJsonObject result;
+            result["scene"] = conf.sceneName;
+            result["error"] = QString("cannot create scene");
+            results.append(result);
+            continue;
+        }
+        CamSim::Scene scene = geometryScene;
+        addLights(scene, conf.lights);
+        results.append(runConfiguration(conf, scene, frames, exportDir.path()));
+    }
+    QByteArray json = QJsonDocument(results).toJson();
+
+    /* Report */
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size() || !file.flush()) {
+            qCritical("%s: cannot write file", qPrintable(file.fileName()));
+            return 1;
+        }
+    } else {
+        std::fwrite(json.constData(), 1, json.size(), stdout);
+    }
+    return 0;
+}
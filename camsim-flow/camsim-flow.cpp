@@ -140,7 +140,6 @@ int main(int argc, char* argv[])
         qInfo("simulating for %08lld", t);
         simulator.simulate(t);
 
-        exporter.waitForAsyncExports();
         QString prefix = QString::asprintf("%04d-", frameCounter);
         //exporter.asyncExportData(prefix + "rgb.ppm", simulator.getSRGB());
         exporter.asyncExportData(prefix + "rgb.png", simulator.getSRGB());
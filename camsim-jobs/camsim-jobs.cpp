@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2018
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <QGuiApplication>
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+#include <QFile>
+
+#include <camsim/camsim.hpp>
+
+/* This example splits the simulation of a sequence into jobs that run in
+ * separate processes, and merges their results:
+ *
+ *   camsim-jobs run <n>         run n local processes, then merge the results
+ *   camsim-jobs job <i> <n>     simulate job i of n (e.g. on a cluster node)
+ *   camsim-jobs merge <n>       merge the results of n jobs
+ *
+ * Because each job starts with the simulator state of its first frame,
+ * the merged results are the same as those of a single process, including
+ * noise and flow. */
+
+static const QStringList outputFileNames = { "rgb.ppm", "flow.pfs" };
+
+static void setup(CamSim::Simulator& simulator)
+{
+    CamSim::Scene scene;
+    CamSim::Generator generator;
+
+    CamSim::Light light;
+    light.type = CamSim::PointLight;
+    light.isRelativeToCamera = true;
+    light.color = QVector3D(2.0f, 2.0f, 2.0f);
+    scene.addLight(light);
+
+    CamSim::Material boxMaterial;
+    boxMaterial.isTwoSided = true;
+    int boxMaterialIndex = scene.addMaterial(boxMaterial);
+    CamSim::Transformation boxTransformation;
+    boxTransformation.scaling = QVector3D(1.0f, 1.0f, 2.0f);
+    generator.addCubeToScene(scene, boxMaterialIndex, boxTransformation);
+
+    CamSim::Material teapotMaterial;
+    teapotMaterial.isTwoSided = true;
+    int teapotMaterialIndex = scene.addMaterial(teapotMaterial);
+    CamSim::Animation teapotAnimation;
+    for (int i = 0; i <= 4; i++) {
+        CamSim::Transformation teapotAnimationTransformation;
+        teapotAnimationTransformation.translation = QVector3D(0.0f, -0.2f, -1.0f);
+        teapotAnimationTransformation.rotation = QQuaternion::fromAxisAndAngle(0.0f, 1.0f, 0.0f, i * 90.0f);
+        teapotAnimation.addKeyframe(i * 1000000, teapotAnimationTransformation);
+    }
+    CamSim::Transformation teapotTransformation;
+    teapotTransformation.scaling = QVector3D(0.3f, 0.3f, 0.3f);
+    generator.addTeapotToScene(scene, teapotMaterialIndex, teapotTransformation, teapotAnimation);
+
+    CamSim::Pipeline pipeline;
+    pipeline.gaussianWhiteNoise = true;
+    pipeline.gaussianWhiteNoiseStddev = 0.02f;
+    CamSim::Output output;
+    output.rgb = true;
+    output.srgb = true;
+    output.forwardFlow2D = true;
+
+    simulator.setScene(scene);
+    simulator.setProjection(CamSim::Projection::fromOpeningAngle(640, 480, 70.0f));
+    simulator.setChipTiming(CamSim::ChipTiming::fromSubFramesPerSecond(25.0f));
+    simulator.setPipeline(pipeline);
+    simulator.setOutput(output);
+    simulator.setRandomSeed(42);
+}
+
+static int runJob(int index, int jobs)
+{
+    CamSim::Context context;
+    CamSim::Simulator simulator;
+    setup(simulator);
+    CamSim::SequenceJob job = CamSim::JobSplitter::job(simulator, index, jobs);
+    qInfo("job %d/%d: frames %d to %d", index, jobs,
+            job.firstFrame, job.firstFrame + job.frameTimestamps.size() - 1);
+    simulator.setState(job.state);
+    QFile::remove(job.partFileName(outputFileNames[0]));
+    QFile::remove(job.partFileName(outputFileNames[1]));
+    CamSim::SequenceWriter rgbWriter(job.partFileName(outputFileNames[0]));
+    CamSim::SequenceWriter flowWriter(job.partFileName(outputFileNames[1]));
+    simulator.simulateBatch(job.frameTimestamps,
+            [&](int, long long) {
+                return QList<CamSim::TexDataFuture>()
+                    << simulator.getSRGBAsync() << simulator.getForwardFlow2DAsync();
+            },
+            [&](int, long long, const QList<CamSim::TexData>& results) {
+                rgbWriter.append(results[0]);
+                flowWriter.append(results[1]);
+            });
+    return (rgbWriter.finish() && flowWriter.finish()) ? 0 : 1;
+}
+
+static int merge(int jobs)
+{
+    for (int i = 0; i < outputFileNames.size(); i++)
+        if (!CamSim::JobSplitter::merge(outputFileNames[i], jobs))
+            return 1;
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    /* Select the OpenGL backend, e.g. with CAMSIM_CONTEXT_BACKEND=egl on GPU servers */
+    if (!CamSim::Context::initializeBackend())
+        return 1;
+    QGuiApplication app(argc, argv);
+    QStringList args = app.arguments();
+    if (args.size() == 3 && args[1] == "run") {
+        int jobs = args[2].toInt();
+        if (jobs < 1 || !CamSim::JobSplitter::runProcesses(app.applicationFilePath(),
+                    { "job", "{job}", "{jobs}" }, jobs))
+            return 1;
+        return merge(jobs);
+    } else if (args.size() == 4 && args[1] == "job") {
+        return runJob(args[2].toInt(), args[3].toInt());
+    } else if (args.size() == 3 && args[1] == "merge") {
+        return merge(args[2].toInt());
+    }
+    qCritical("Usage: %s run <n> | job <i> <n> | merge <n>", argv[0]);
+    return 1;
+}
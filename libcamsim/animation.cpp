@@ -35,11 +35,11 @@ namespace CamSim {
 
 static const float epsilon = 0.0001f;
 
-Animation::Animation()
+Animation::Animation() : _cursor(0)
 {
 }
 
-Animation::Animation(const QList<Keyframe>& kfs) : _keyframes(kfs)
+Animation::Animation(const QList<Keyframe>& kfs) : _keyframes(kfs), _cursor(0)
 {
 }
 
@@ -69,8 +69,23 @@ static void findKeyframeIndices(const QList<Animation::Keyframe>& keyframes,
     higherIndex = a;
 }
 
+static bool findKeyframeIndicesNearCursor(const QList<Animation::Keyframe>& keyframes,
+        long long t, int cursor, int& lowerIndex, int& higherIndex)
+{
+    // Check the interval at the cursor and the one after it
+    for (int c = cursor; c <= cursor + 1 && c + 1 < keyframes.size(); c++) {
+        if (keyframes[c].t <= t && t < keyframes[c + 1].t) {
+            lowerIndex = c;
+            higherIndex = (keyframes[c].t == t ? c : c + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
 void Animation::addKeyframe(const Keyframe& keyframe)
 {
+    _cursor = 0;
     if (_keyframes.size() == 0) {
         _keyframes.append(keyframe);
     } else if (keyframe.t > endTime()) {
@@ -102,7 +117,9 @@ Transformation Animation::interpolate(long long t)
     }
 
     int lowerIndex, higherIndex;
-    findKeyframeIndices(_keyframes, t, lowerIndex, higherIndex);
+    if (!findKeyframeIndicesNearCursor(_keyframes, t, _cursor, lowerIndex, higherIndex))
+        findKeyframeIndices(_keyframes, t, lowerIndex, higherIndex);
+    _cursor = lowerIndex;
     if (lowerIndex == higherIndex) {
         return _keyframes[lowerIndex].transformation;
     }
@@ -127,6 +144,7 @@ bool Animation::load(const QString& filename)
 
     QList<Keyframe> keyframesBackup = _keyframes;
     _keyframes.clear();
+    _cursor = 0;
 
     int lineCounter = 0;
     while (!in.atEnd()) {
@@ -73,6 +73,7 @@ public:
 
 private:
     QList<Keyframe> _keyframes; // list of keyframes, sorted by ascending time
+    int _cursor; // lower keyframe index of the interval found by the last interpolate() call
 
 public:
     /** \brief Constructor
@@ -126,6 +127,10 @@ public:
      * \param t         Point in time, in microseconds
      *
      * Returns the transformation at the given point in time.
+     *
+     * The keyframe interval found for \a t is remembered, so that subsequent
+     * calls with the same or slightly larger times do not need to search the
+     * keyframes again.
      */
     Transformation interpolate(long long t);
 
@@ -28,6 +28,9 @@
 #include "generator.hpp"
 #include "importer.hpp"
 #include "simulator.hpp"
+#include "tiledsimulator.hpp"
+#include "scheduler.hpp"
+#include "jobs.hpp"
 #include "texdata.hpp"
 #include "exporter.hpp"
 
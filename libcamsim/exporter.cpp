@@ -22,13 +22,16 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 
 #include <QFile>
+#include <QMap>
 #include <QTextStream>
 #include <QImage>
 #include <QFuture>
+#include <QMutexLocker>
 #include <QtConcurrent>
 
 #ifdef HAVE_GTA
@@ -47,10 +50,37 @@
 
 namespace CamSim {
 
-Exporter::Exporter()
+Exporter::Exporter() :
+    _asyncQueuedBytes(0),
+    _asyncMemoryBudget(size_t(1) << 30),
+    _asyncOk(true),
+    _asyncUnfinishedExports(0)
 {
 }
 
+Exporter::~Exporter()
+{
+    waitForAsyncExports();
+}
+
+void Exporter::setAsyncExportThreads(int threads)
+{
+    _asyncPool.setMaxThreadCount(threads);
+}
+
+void Exporter::setAsyncExportMemoryBudget(size_t bytes)
+{
+    QMutexLocker locker(&_asyncMutex);
+    _asyncMemoryBudget = bytes;
+    _asyncCondition.wakeAll();
+}
+
+void Exporter::setAsyncExportErrorCallback(const std::function<void (const QString& fileName)>& callback)
+{
+    QMutexLocker locker(&_asyncMutex);
+    _asyncErrorCallback = callback;
+}
+
 bool Exporter::isFileFormatSupported(FileFormat format)
 {
     switch (format) {
@@ -154,7 +184,7 @@ FileFormat Exporter::fileFormatFromName(const QString& fileName)
         return FileFormat_Auto;
 }
 
-bool Exporter::checkExportRequest(Exporter* asyncExporter,
+bool Exporter::checkExportRequest(
         const QString& fileName, FileFormat format,
         const QList<TexData>& dataList, const QList<QList<int>>& channelsList,
         int compressionLevel,
@@ -178,12 +208,6 @@ bool Exporter::checkExportRequest(Exporter* asyncExporter,
         qCritical("%s: file format not supported (library missing)", qPrintable(fileName));
         return false;
     }
-    if (asyncExporter) {
-        if (asyncExporter->_asyncExportFileNames.contains(fileName)) {
-            qCritical("%s: cannot have more than one async export per file", qPrintable(fileName));
-            return false;
-        }
-    }
     if (channelsList.size() != 0 && channelsList.size() != dataList.size()) {
         qCritical("%s: number of channel lists does not match number of data", qPrintable(fileName));
         return false;
@@ -231,6 +255,17 @@ bool Exporter::checkExportRequest(Exporter* asyncExporter,
     return true;
 }
 
+// Convert half float data to float; all writers handle float data only.
+// This happens in the thread that writes, so that asynchronous exports
+// keep the conversion off the simulation thread.
+static QList<TexData> toFloatData(const QList<TexData>& dataList)
+{
+    QList<TexData> convertedList;
+    for (int i = 0; i < dataList.size(); i++)
+        convertedList.append(dataList[i].toFloat());
+    return convertedList;
+}
+
 bool Exporter::exportData(Exporter* asyncExporter,
         const QString& fileName, FileFormat format,
         const QList<TexData>& dataList,
@@ -240,89 +275,110 @@ bool Exporter::exportData(Exporter* asyncExporter,
     FileFormat cleanedFormat;
     QList<QList<int>> cleanedChannelsList;
     int cleanedCompressionLevel;
-    if (!checkExportRequest(asyncExporter, fileName, format,
+    if (!checkExportRequest(fileName, format,
                 dataList, channelsList, compressionLevel,
                 cleanedFormat, cleanedChannelsList, cleanedCompressionLevel)) {
         return false;
     }
+    WriteFunction write = writeFunction(cleanedFormat);
     if (asyncExporter) {
-        asyncExporter->_asyncExportFileNames.append(fileName);
-        QFuture<bool> exp;
-        switch (cleanedFormat) {
-        case FileFormat_RAW:
-            exp = QtConcurrent::run(writeRAW, fileName, dataList, cleanedChannelsList, cleanedCompressionLevel);
-            break;
-        case FileFormat_CSV:
-            exp = QtConcurrent::run(writeCSV, fileName, dataList, cleanedChannelsList, cleanedCompressionLevel);
-            break;
-        case FileFormat_PNM:
-            exp = QtConcurrent::run(writePNM, fileName, dataList, cleanedChannelsList, cleanedCompressionLevel);
-            break;
-        case FileFormat_PNG:
-            exp = QtConcurrent::run(writePNG, fileName, dataList, cleanedChannelsList, cleanedCompressionLevel);
-            break;
-        case FileFormat_PFS:
-            exp = QtConcurrent::run(writePFS, fileName, dataList, cleanedChannelsList, cleanedCompressionLevel);
-            break;
-        case FileFormat_GTA:
-            exp = QtConcurrent::run(writeGTA, fileName, dataList, cleanedChannelsList, cleanedCompressionLevel);
-            break;
-        case FileFormat_MAT:
-            exp = QtConcurrent::run(writeMAT, fileName, dataList, cleanedChannelsList, cleanedCompressionLevel);
-            break;
-        case FileFormat_HDF5:
-            exp = QtConcurrent::run(writeHDF, fileName, dataList, cleanedChannelsList, cleanedCompressionLevel);
-            break;
-        case FileFormat_Auto:
-            // cannot happen
-            break;
-        }
-        asyncExporter->_asyncExports.append(exp);
-        return true;
+        return asyncExporter->startAsyncExport(fileName, write,
+                dataList, cleanedChannelsList, cleanedCompressionLevel);
     } else {
-        switch (cleanedFormat) {
-        case FileFormat_RAW:
-            return writeRAW(fileName, dataList, cleanedChannelsList, cleanedCompressionLevel);
-            break;
-        case FileFormat_CSV:
-            return writeCSV(fileName, dataList, cleanedChannelsList, cleanedCompressionLevel);
-            break;
-        case FileFormat_PNM:
-            return writePNM(fileName, dataList, cleanedChannelsList, cleanedCompressionLevel);
-            break;
-        case FileFormat_PNG:
-            return writePNG(fileName, dataList, cleanedChannelsList, cleanedCompressionLevel);
-            break;
-        case FileFormat_PFS:
-            return writePFS(fileName, dataList, cleanedChannelsList, cleanedCompressionLevel);
-            break;
-        case FileFormat_GTA:
-            return writeGTA(fileName, dataList, cleanedChannelsList, cleanedCompressionLevel);
-            break;
-        case FileFormat_MAT:
-            return writeMAT(fileName, dataList, cleanedChannelsList, cleanedCompressionLevel);
-            break;
-        case FileFormat_HDF5:
-            return writeHDF(fileName, dataList, cleanedChannelsList, cleanedCompressionLevel);
-            break;
-        case FileFormat_Auto:
-            // cannot happen
-            break;
+        return write(fileName, toFloatData(dataList), cleanedChannelsList, cleanedCompressionLevel);
+    }
+}
+
+Exporter::WriteFunction Exporter::writeFunction(FileFormat format)
+{
+    switch (format) {
+    case FileFormat_RAW:
+        return writeRAW;
+    case FileFormat_CSV:
+        return writeCSV;
+    case FileFormat_PNM:
+        return writePNM;
+    case FileFormat_PNG:
+        return writePNG;
+    case FileFormat_PFS:
+        return writePFS;
+    case FileFormat_GTA:
+        return writeGTA;
+    case FileFormat_MAT:
+        return writeMAT;
+    case FileFormat_HDF5:
+    case FileFormat_Auto: // cannot happen
+    default:
+        return writeHDF;
+    }
+}
+
+bool Exporter::startAsyncExport(const QString& fileName, WriteFunction write,
+        const QList<TexData>& dataList,
+        const QList<QList<int>>& channelsList,
+        int compressionLevel)
+{
+    size_t bytes = 0;
+    for (int i = 0; i < dataList.size(); i++)
+        bytes += dataList[i].packedDataSize();
+
+    QMutexLocker locker(&_asyncMutex);
+    // Backpressure: block while the queued data exceeds the memory budget
+    while (_asyncQueuedBytes > 0 && _asyncQueuedBytes + bytes > _asyncMemoryBudget)
+        _asyncCondition.wait(&_asyncMutex);
+    _asyncQueuedBytes += bytes;
+    _asyncUnfinishedExports++;
+    std::function<void ()> task = [=]() {
+        bool ok = write(fileName, toFloatData(dataList), channelsList, compressionLevel);
+        finishAsyncExport(fileName, bytes, ok);
+    };
+    // Exports to the same file are queued while one of them is running; the
+    // running one starts the next when it finishes, so that no thread blocks.
+    auto it = _asyncFileQueues.find(fileName);
+    if (it != _asyncFileQueues.end()) {
+        it.value().append(task);
+    } else {
+        _asyncFileQueues.insert(fileName, QList<std::function<void ()>>());
+        QtConcurrent::run(&_asyncPool, task);
+    }
+    return true;
+}
+
+void Exporter::finishAsyncExport(const QString& fileName, size_t bytes, bool ok)
+{
+    std::function<void (const QString& fileName)> callback;
+    std::function<void ()> next;
+    {
+        QMutexLocker locker(&_asyncMutex);
+        _asyncQueuedBytes -= bytes;
+        if (!ok) {
+            _asyncOk = false;
+            callback = _asyncErrorCallback;
         }
-        return false;
+        auto it = _asyncFileQueues.find(fileName);
+        if (it.value().isEmpty())
+            _asyncFileQueues.erase(it);
+        else
+            next = it.value().takeFirst();
+        _asyncCondition.wakeAll();
     }
+    if (next)
+        QtConcurrent::run(&_asyncPool, next);
+    if (callback)
+        callback(fileName);
+    // Only now is this export finished for waitForAsyncExports()
+    QMutexLocker locker(&_asyncMutex);
+    _asyncUnfinishedExports--;
+    _asyncCondition.wakeAll();
 }
 
 bool Exporter::waitForAsyncExports()
 {
-    bool ok = true;
-    for (int i = 0; i < _asyncExports.size(); i++) {
-        bool asyncOk = _asyncExports[i].result();
-        if (!asyncOk)
-            ok = false;
-    }
-    _asyncExports.clear();
-    _asyncExportFileNames.clear();
+    QMutexLocker locker(&_asyncMutex);
+    while (_asyncUnfinishedExports > 0)
+        _asyncCondition.wait(&_asyncMutex);
+    bool ok = _asyncOk;
+    _asyncOk = true;
     return ok;
 }
 
@@ -337,23 +393,26 @@ static bool haveDefaultChannels(const TexData& data, const QList<int>& channels)
     return defaultChannels;
 }
 
-bool Exporter::writeRAW(const QString fileName, const QList<TexData> dataList, const QList<QList<int>> channelsList, int /* compressionLevel */)
+static bool writeRAWToStream(const QString& fileName, QIODevice& file, QIODevice& header,
+        const QList<TexData>& dataList, const QList<QList<int>>& channelsList)
 {
-    QFile file(fileName);
-    QFile header(fileName + "_header");
-    if (!file.open(QIODevice::Append) || !header.open(QIODevice::Append)) {
-        qCritical("%s: cannot open for writing", qPrintable(fileName));
-        return false;
-    }
     for (int i = 0; i < dataList.size(); i++) {
         const TexData& data = dataList[i];
         const QList<int>& channels = channelsList[i];
-        if (haveDefaultChannels(data, channels)) {
+        if (haveDefaultChannels(data, channels) && !data.isBottomUp()) {
             unsigned int n = file.write(static_cast<const char*>(data.packedData()), data.packedDataSize());
             if (n != data.packedDataSize()) {
                 qCritical("%s: write error", qPrintable(fileName));
                 return false;
             }
+        } else if (haveDefaultChannels(data, channels)) {
+            for (int y = 0; y < data.height(); y++) {
+                unsigned int n = file.write(static_cast<const char*>(data.packedLine(y)), data.packedLineSize());
+                if (n != data.packedLineSize()) {
+                    qCritical("%s: write error", qPrintable(fileName));
+                    return false;
+                }
+            }
         } else {
             for (int y = 0; y < data.height(); y++) {
                 for (int x = 0; x < data.width(); x++) {
@@ -381,6 +440,19 @@ bool Exporter::writeRAW(const QString fileName, const QList<TexData> dataList, c
         }
         headerStream << '\n';
     }
+    return true;
+}
+
+bool Exporter::writeRAW(const QString fileName, const QList<TexData> dataList, const QList<QList<int>> channelsList, int /* compressionLevel */)
+{
+    QFile file(fileName);
+    QFile header(fileName + "_header");
+    if (!file.open(QIODevice::Append) || !header.open(QIODevice::Append)) {
+        qCritical("%s: cannot open for writing", qPrintable(fileName));
+        return false;
+    }
+    if (!writeRAWToStream(fileName, file, header, dataList, channelsList))
+        return false;
     if (!file.flush() || !header.flush()) {
         qCritical("%s: write error", qPrintable(fileName));
         return false;
@@ -433,6 +505,24 @@ bool Exporter::writeCSV(const QString fileName, const QList<TexData> dataList, c
     return true;
 }
 
+static bool writePNMToStream(const QString& /* fileName */, FILE* f,
+        const QList<TexData>& dataList, const QList<QList<int>>& channelsList, int /* compressionLevel */)
+{
+    for (int i = 0; i < dataList.size(); i++) {
+        const TexData& data = dataList[i];
+        const QList<int>& channels = channelsList[i];
+        std::fprintf(f, "P%d\n%d %d\n255\n", channels.size() == 1 ? 5 : 6,
+                data.width(), data.height());
+        if (data.isBottomUp()) {
+            for (int y = 0; y < data.height(); y++)
+                std::fwrite(data.packedLine(y), data.width() * data.channels(), 1, f);
+        } else {
+            std::fwrite(data.packedData(), data.width() * data.height() * data.channels(), 1, f);
+        }
+    }
+    return (std::ferror(f) == 0);
+}
+
 bool Exporter::writePNM(const QString fileName, const QList<TexData> dataList, const QList<QList<int>> channelsList, int /* compressionLevel */)
 {
     FILE* f = std::fopen(qPrintable(fileName), "ab");
@@ -440,15 +530,10 @@ bool Exporter::writePNM(const QString fileName, const QList<TexData> dataList, c
         qCritical("%s: cannot open for writing", qPrintable(fileName));
         return false;
     }
-    for (int i = 0; i < dataList.size(); i++) {
-        const TexData& data = dataList[i];
-        const QList<int>& channels = channelsList[i];
-        const unsigned char* imgDataPtr;
-        QVector<unsigned char> imgData;
-        imgDataPtr = static_cast<const unsigned char*>(data.packedData());
-        std::fprintf(f, "P%d\n%d %d\n255\n", channels.size() == 1 ? 5 : 6,
-                data.width(), data.height());
-        std::fwrite(imgDataPtr, data.width() * data.height() * data.channels(), 1, f);
+    if (!writePNMToStream(fileName, f, dataList, channelsList, 0)) {
+        std::fclose(f);
+        qCritical("%s: write error", qPrintable(fileName));
+        return false;
     }
     if (std::fflush(f) != 0 || std::fclose(f) != 0) {
         qCritical("%s: write error", qPrintable(fileName));
@@ -461,11 +546,18 @@ bool Exporter::writePNG(const QString fileName, const QList<TexData> dataList, c
 {
     const TexData& data = dataList[0];
     const QList<int>& channels = channelsList[0];
-    if (data.type() == GL_UNSIGNED_BYTE && data.packedLineSize() % 4 == 0) {
+    if (data.type() == GL_UNSIGNED_BYTE && data.packedLineSize() % 4 == 0 && !data.isBottomUp()) {
         /* fast path for common case */
         QImage img(static_cast<const uchar*>(data.packedData()), data.width(), data.height(),
                 channels.size() == 1 ? QImage::Format_Grayscale8 : QImage::Format_RGB888);
         return img.save(fileName, "PNG", 11 * (9 - compressionLevel) + 1);
+    } else if (data.type() == GL_UNSIGNED_BYTE && haveDefaultChannels(data, channels)) {
+        /* fast path for texture data: copy whole lines */
+        QImage img(data.width(), data.height(),
+                channels.size() == 1 ? QImage::Format_Grayscale8 : QImage::Format_RGB888);
+        for (int y = 0; y < data.height(); y++)
+            std::memcpy(img.scanLine(y), data.packedLine(y), data.packedLineSize());
+        return img.save(fileName, "PNG", 11 * (9 - compressionLevel) + 1);
     } else {
         QImage img(data.width(), data.height(),
                 channels.size() == 1 ? QImage::Format_Grayscale8 : QImage::Format_RGB888);
@@ -483,13 +575,9 @@ bool Exporter::writePNG(const QString fileName, const QList<TexData> dataList, c
     }
 }
 
-bool Exporter::writePFS(const QString fileName, const QList<TexData> dataList, const QList<QList<int>> channelsList, int /* compressionLevel */)
+static bool writePFSToStream(const QString& /* fileName */, FILE* f,
+        const QList<TexData>& dataList, const QList<QList<int>>& channelsList, int /* compressionLevel */)
 {
-    FILE* f = std::fopen(qPrintable(fileName), "ab");
-    if (!f) {
-        qCritical("%s: cannot open for writing", qPrintable(fileName));
-        return false;
-    }
     for (int i = 0; i < dataList.size(); i++) {
         const TexData& data = dataList[i];
         const QList<int>& channels = channelsList[i];
@@ -507,7 +595,8 @@ bool Exporter::writePFS(const QString fileName, const QList<TexData> dataList, c
         QByteArray channelData;
         for (int c = 0; c < channels.size(); c++) {
             if (data.type() == GL_FLOAT) {
-                channelData = data.planarDataArray(channels[c]);
+                channelData.resize(data.planarDataSize());
+                TexDataPlane(data, channels[c]).copyTo(channelData.data());
                 std::fwrite(channelData.constData(), data.planarDataSize(), 1, f);
             } else {
                 channelData.resize(data.width() * data.height() * sizeof(float));
@@ -525,21 +614,32 @@ bool Exporter::writePFS(const QString fileName, const QList<TexData> dataList, c
             }
         }
     }
-    if (std::fflush(f) != 0 || std::fclose(f) != 0) {
-        qCritical("%s: write error", qPrintable(fileName));
-        return false;
-    }
-    return true;
+    return (std::ferror(f) == 0);
 }
 
-bool Exporter::writeGTA(const QString fileName, const QList<TexData> dataList, const QList<QList<int>> channelsList, int compressionLevel)
+bool Exporter::writePFS(const QString fileName, const QList<TexData> dataList, const QList<QList<int>> channelsList, int /* compressionLevel */)
 {
-#ifdef HAVE_GTA
     FILE* f = std::fopen(qPrintable(fileName), "ab");
     if (!f) {
         qCritical("%s: cannot open for writing", qPrintable(fileName));
         return false;
     }
+    if (!writePFSToStream(fileName, f, dataList, channelsList, 0)) {
+        std::fclose(f);
+        qCritical("%s: write error", qPrintable(fileName));
+        return false;
+    }
+    if (std::fflush(f) != 0 || std::fclose(f) != 0) {
+        qCritical("%s: write error", qPrintable(fileName));
+        return false;
+    }
+    return true;
+}
+
+#ifdef HAVE_GTA
+static bool writeGTAToStream(const QString& fileName, FILE* f,
+        const QList<TexData>& dataList, const QList<QList<int>>& channelsList, int compressionLevel)
+{
     try {
         for (int i = 0; i < dataList.size(); i++) {
             const TexData& data = dataList[i];
@@ -599,7 +699,13 @@ bool Exporter::writeGTA(const QString fileName, const QList<TexData> dataList, c
                         hdr.component_taglist(c).set("INTERPRETATION", qPrintable(data.channelName(c)));
                 }
                 hdr.write_to(f);
-                hdr.write_data(f, data.packedData());
+                if (data.isBottomUp()) {
+                    gta::io_state iostate;
+                    for (int y = 0; y < data.height(); y++)
+                        hdr.write_elements(iostate, f, data.width(), data.packedLine(y));
+                } else {
+                    hdr.write_data(f, data.packedData());
+                }
             } else {
                 std::vector<gta::type> types(channels.size(), componentType);
                 hdr.set_components(channels.size(), &(types[0]));
@@ -628,6 +734,22 @@ bool Exporter::writeGTA(const QString fileName, const QList<TexData> dataList, c
         qCritical("%s: %s", qPrintable(fileName), e.what());
         return false;
     }
+    return (std::ferror(f) == 0);
+}
+#endif
+
+bool Exporter::writeGTA(const QString fileName, const QList<TexData> dataList, const QList<QList<int>> channelsList, int compressionLevel)
+{
+#ifdef HAVE_GTA
+    FILE* f = std::fopen(qPrintable(fileName), "ab");
+    if (!f) {
+        qCritical("%s: cannot open for writing", qPrintable(fileName));
+        return false;
+    }
+    if (!writeGTAToStream(fileName, f, dataList, channelsList, compressionLevel)) {
+        std::fclose(f);
+        return false;
+    }
     if (std::fflush(f) != 0 || std::fclose(f) != 0) {
         qCritical("%s: write error", qPrintable(fileName));
         return false;
@@ -653,6 +775,7 @@ bool Exporter::writeMAT(const QString fileName, const QList<TexData> dataList, c
         return false;
     }
     int defaultNameCounter = 0;
+    QByteArray transposedPlanarData; // reused for all variables
     for (int i = 0; i < dataList.size(); i++) {
         const TexData& data = dataList[i];
         const QList<int>& channels = channelsList[i];
@@ -678,9 +801,10 @@ bool Exporter::writeMAT(const QString fileName, const QList<TexData> dataList, c
             if (varName.isEmpty())
                 varName = QString("CAMSIM") + QString::number(defaultNameCounter++);
             size_t dims[2] = { static_cast<size_t>(data.height()), static_cast<size_t>(data.width()) };
-            QByteArray transposedPlanarDataArray = data.transposedPlanarDataArray(channels[c]);
+            transposedPlanarData.resize(data.planarDataSize());
+            TexDataPlane(data, channels[c], true).copyTo(transposedPlanarData.data());
             matvar_t *matvar = Mat_VarCreate(qPrintable(varName), classType, dataType, 2, &(dims[0]),
-                    transposedPlanarDataArray.data(), MAT_F_DONT_COPY_DATA);
+                    transposedPlanarData.data(), MAT_F_DONT_COPY_DATA);
             if (!matvar) {
                 qCritical("%s: cannot create variable", qPrintable(fileName));
                 Mat_Close(mat);
@@ -709,6 +833,7 @@ bool Exporter::writeHDF(const QString fileName, const QList<TexData> dataList, c
 {
 #ifdef HAVE_HDF5
     int defaultNameCounter = 0;
+    QByteArray transposedPlanarData; // reused for all datasets
     try {
         H5::Exception::dontPrint();
         H5::H5File file(qPrintable(fileName), H5F_ACC_TRUNC);
@@ -722,26 +847,27 @@ bool Exporter::writeHDF(const QString fileName, const QList<TexData> dataList, c
                 QString varName = data.channelName(channels[c]);
                 if (varName.isEmpty())
                     varName = QString("CAMSIM") + QString::number(defaultNameCounter++);
-                QByteArray transposedPlanarDataArray = data.transposedPlanarDataArray(channels[c]);
                 hsize_t dims[2] = { static_cast<hsize_t>(data.width()), static_cast<hsize_t>(data.height()) };
                 H5::DataSpace dataspace(2, dims);
                 H5::DSetCreatPropList proplist;
                 if (compressionLevel > 0)
                     proplist.setDeflate(compressionLevel);
                 H5::DataSet dataset;
+                transposedPlanarData.resize(data.planarDataSize());
+                TexDataPlane(data, channels[c], true).copyTo(transposedPlanarData.data());
                 switch (data.type()) {
                 case GL_UNSIGNED_BYTE:
                     dataset = file.createDataSet(qPrintable(varName), uchartype, dataspace, proplist);
-                    dataset.write(transposedPlanarDataArray.constData(), H5::PredType::NATIVE_UCHAR);
+                    dataset.write(transposedPlanarData.constData(), H5::PredType::NATIVE_UCHAR);
                     break;
                 case GL_UNSIGNED_INT:
                     dataset = file.createDataSet(qPrintable(varName), uinttype, dataspace, proplist);
-                    dataset.write(transposedPlanarDataArray.constData(), H5::PredType::NATIVE_UINT);
+                    dataset.write(transposedPlanarData.constData(), H5::PredType::NATIVE_UINT);
                     break;
                 case GL_FLOAT:
                 default:
                     dataset = file.createDataSet(qPrintable(varName), floattype, dataspace, proplist);
-                    dataset.write(transposedPlanarDataArray.constData(), H5::PredType::NATIVE_FLOAT);
+                    dataset.write(transposedPlanarData.constData(), H5::PredType::NATIVE_FLOAT);
                     break;
                 }
             }
@@ -761,4 +887,264 @@ bool Exporter::writeHDF(const QString fileName, const QList<TexData> dataList, c
 #endif
 }
 
+
+class SequenceWriterHDF5State
+{
+public:
+#ifdef HAVE_HDF5
+    H5::H5File file;
+    QMap<QString, H5::DataSet> datasets;
+    QMap<QString, hsize_t> frames;
+#endif
+};
+
+static bool writeHDFToStream(const QString& fileName, SequenceWriterHDF5State* state,
+        int chunkFrames, int chunkLines, int chunkColumns,
+        const QList<TexData>& dataList, const QList<QList<int>>& channelsList, int compressionLevel)
+{
+#ifdef HAVE_HDF5
+    int defaultNameCounter = 0;
+    QByteArray planarData; // reused for all datasets
+    try {
+        H5::Exception::dontPrint();
+        for (int i = 0; i < dataList.size(); i++) {
+            const TexData& data = dataList[i];
+            const QList<int>& channels = channelsList[i];
+            const H5::PredType& memType = (data.type() == GL_UNSIGNED_BYTE ? H5::PredType::NATIVE_UCHAR
+                    : data.type() == GL_UNSIGNED_INT ? H5::PredType::NATIVE_UINT
+                    : H5::PredType::NATIVE_FLOAT);
+            hsize_t height = data.height();
+            hsize_t width = data.width();
+            for (int c = 0; c < channels.size(); c++) {
+                QString varName = data.channelName(channels[c]);
+                if (varName.isEmpty())
+                    varName = QString("CAMSIM") + QString::number(defaultNameCounter++);
+                auto it = state->datasets.find(varName);
+                if (it == state->datasets.end()) {
+                    hsize_t dims[3] = { 0, height, width };
+                    hsize_t maxDims[3] = { H5S_UNLIMITED, height, width };
+                    H5::DataSpace dataspace(3, dims, maxDims);
+                    hsize_t chunk[3] = {
+                        static_cast<hsize_t>(std::max(chunkFrames, 1)),
+                        chunkLines > 0 ? std::min(static_cast<hsize_t>(chunkLines), height) : height,
+                        chunkColumns > 0 ? std::min(static_cast<hsize_t>(chunkColumns), width) : width
+                    };
+                    H5::DSetCreatPropList proplist;
+                    proplist.setChunk(3, chunk);
+                    if (compressionLevel > 0)
+                        proplist.setDeflate(compressionLevel);
+                    it = state->datasets.insert(varName,
+                            state->file.createDataSet(qPrintable(varName), memType, dataspace, proplist));
+                    state->frames.insert(varName, 0);
+                }
+                H5::DataSet& dataset = it.value();
+                hsize_t frame = state->frames.value(varName);
+                hsize_t oldDims[3];
+                dataset.getSpace().getSimpleExtentDims(oldDims);
+                if (oldDims[1] != height || oldDims[2] != width) {
+                    qCritical("%s: %s: data dimensions differ from previous frames", qPrintable(fileName), qPrintable(varName));
+                    return false;
+                }
+                hsize_t newDims[3] = { frame + 1, height, width };
+                dataset.extend(newDims);
+                H5::DataSpace fileSpace = dataset.getSpace();
+                hsize_t start[3] = { frame, 0, 0 };
+                hsize_t count[3] = { 1, height, width };
+                fileSpace.selectHyperslab(H5S_SELECT_SET, count, start);
+                H5::DataSpace memSpace(3, count);
+                planarData.resize(data.planarDataSize());
+                TexDataPlane(data, channels[c]).copyTo(planarData.data());
+                dataset.write(planarData.constData(), memType, memSpace, fileSpace);
+                state->frames[varName] = frame + 1;
+            }
+        }
+    }
+    catch (H5::Exception& error) {
+        qCritical("%s: %s", qPrintable(fileName), error.getCDetailMsg());
+        return false;
+    }
+    return true;
+#else
+    Q_UNUSED(fileName);
+    Q_UNUSED(state);
+    Q_UNUSED(chunkFrames);
+    Q_UNUSED(chunkLines);
+    Q_UNUSED(chunkColumns);
+    Q_UNUSED(dataList);
+    Q_UNUSED(channelsList);
+    Q_UNUSED(compressionLevel);
+    return false;
+#endif
+}
+
+SequenceWriter::SequenceWriter(const QString& fileName, FileFormat format, size_t bufferSize) :
+    _fileName(fileName),
+    _format(format == FileFormat_Auto ? Exporter::fileFormatFromName(fileName) : format),
+    _stream(nullptr),
+    _hdf5(nullptr),
+    _hdf5ChunkFrames(1),
+    _hdf5ChunkLines(0),
+    _hdf5ChunkColumns(0),
+    _ok(true)
+{
+    // a single thread guarantees that appends are written in order
+    _queue.setMaxThreadCount(1);
+    _queue.setExpiryTimeout(-1);
+    if (!Exporter::isFileFormatSupported(_format)) {
+        qCritical("%s: file format not supported (library missing)", qPrintable(_fileName));
+        _ok = false;
+        return;
+    }
+    switch (_format) {
+    case FileFormat_RAW:
+        _rawFile.setFileName(_fileName);
+        _rawHeaderFile.setFileName(_fileName + "_header");
+        if (!_rawFile.open(QIODevice::Append) || !_rawHeaderFile.open(QIODevice::Append)) {
+            qCritical("%s: cannot open for writing", qPrintable(_fileName));
+            _ok = false;
+        }
+        break;
+    case FileFormat_PNM:
+    case FileFormat_PFS:
+    case FileFormat_GTA:
+        _stream = std::fopen(qPrintable(_fileName), "ab");
+        if (!_stream) {
+            qCritical("%s: cannot open for writing", qPrintable(_fileName));
+            _ok = false;
+        } else if (bufferSize > 0) {
+            _streamBuffer.resize(bufferSize);
+            std::setvbuf(_stream, _streamBuffer.data(), _IOFBF, _streamBuffer.size());
+        }
+        break;
+    case FileFormat_HDF5:
+#ifdef HAVE_HDF5
+        try {
+            H5::Exception::dontPrint();
+            _hdf5 = new SequenceWriterHDF5State;
+            _hdf5->file = H5::H5File(qPrintable(_fileName), H5F_ACC_TRUNC);
+        }
+        catch (H5::Exception& error) {
+            qCritical("%s: %s", qPrintable(_fileName), error.getCDetailMsg());
+            delete _hdf5;
+            _hdf5 = nullptr;
+            _ok = false;
+        }
+#endif
+        break;
+    default:
+        qCritical("%s: file format cannot hold sequences", qPrintable(_fileName));
+        _ok = false;
+        break;
+    }
+}
+
+SequenceWriter::~SequenceWriter()
+{
+    finish();
+}
+
+bool SequenceWriter::isOpen() const
+{
+    return _ok && (_stream || _rawFile.isOpen() || _hdf5);
+}
+
+void SequenceWriter::setHDF5ChunkShape(int frames, int lines, int columns)
+{
+    _hdf5ChunkFrames = frames;
+    _hdf5ChunkLines = lines;
+    _hdf5ChunkColumns = columns;
+}
+
+bool SequenceWriter::writeToStream(const QList<TexData>& dataList, const QList<QList<int>>& channelsList, int compressionLevel)
+{
+    switch (_format) {
+    case FileFormat_RAW:
+        return writeRAWToStream(_fileName, _rawFile, _rawHeaderFile, dataList, channelsList);
+    case FileFormat_PNM:
+        return writePNMToStream(_fileName, _stream, dataList, channelsList, compressionLevel);
+    case FileFormat_PFS:
+        return writePFSToStream(_fileName, _stream, dataList, channelsList, compressionLevel);
+    case FileFormat_GTA:
+#ifdef HAVE_GTA
+        return writeGTAToStream(_fileName, _stream, dataList, channelsList, compressionLevel);
+#endif
+    case FileFormat_HDF5:
+        return writeHDFToStream(_fileName, _hdf5,
+                _hdf5ChunkFrames, _hdf5ChunkLines, _hdf5ChunkColumns,
+                dataList, channelsList, compressionLevel);
+    default:
+        return false;
+    }
+}
+
+bool SequenceWriter::append(const QList<TexData>& dataList,
+        const QList<QList<int>>& channelsList,
+        int compressionLevel)
+{
+    if (!isOpen()) {
+        qCritical("%s: cannot append to sequence", qPrintable(_fileName));
+        return false;
+    }
+    FileFormat cleanedFormat;
+    QList<QList<int>> cleanedChannelsList;
+    int cleanedCompressionLevel;
+    if (!Exporter::checkExportRequest(_fileName, _format,
+                dataList, channelsList, compressionLevel,
+                cleanedFormat, cleanedChannelsList, cleanedCompressionLevel)) {
+        return false;
+    }
+    _pendingAppends.append(QtConcurrent::run(&_queue, [=]() {
+                return writeToStream(toFloatData(dataList), cleanedChannelsList, cleanedCompressionLevel);
+            }));
+    return true;
+}
+
+bool SequenceWriter::flush()
+{
+    for (int i = 0; i < _pendingAppends.size(); i++) {
+        if (!_pendingAppends[i].result()) {
+            qCritical("%s: write error", qPrintable(_fileName));
+            _ok = false;
+        }
+    }
+    _pendingAppends.clear();
+    if (_stream && std::fflush(_stream) != 0) {
+        qCritical("%s: write error", qPrintable(_fileName));
+        _ok = false;
+    }
+    if (_rawFile.isOpen() && (!_rawFile.flush() || !_rawHeaderFile.flush())) {
+        qCritical("%s: write error", qPrintable(_fileName));
+        _ok = false;
+    }
+#ifdef HAVE_HDF5
+    if (_hdf5) {
+        try {
+            _hdf5->file.flush(H5F_SCOPE_GLOBAL);
+        }
+        catch (H5::Exception& error) {
+            qCritical("%s: %s", qPrintable(_fileName), error.getCDetailMsg());
+            _ok = false;
+        }
+    }
+#endif
+    return _ok;
+}
+
+bool SequenceWriter::finish()
+{
+    bool ok = flush();
+    if (_stream) {
+        if (std::fclose(_stream) != 0) {
+            qCritical("%s: write error", qPrintable(_fileName));
+            ok = false;
+        }
+        _stream = nullptr;
+    }
+    _rawFile.close();
+    _rawHeaderFile.close();
+    delete _hdf5;
+    _hdf5 = nullptr;
+    return ok;
+}
+
 }
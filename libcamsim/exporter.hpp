@@ -25,8 +25,18 @@
 #ifndef CAMSIM_EXPORTER_HPP
 #define CAMSIM_EXPORTER_HPP
 
+#include <cstdio>
+#include <vector>
+
+#include <functional>
+
 #include <QList>
+#include <QMap>
 #include <QFuture>
+#include <QFile>
+#include <QThreadPool>
+#include <QMutex>
+#include <QWaitCondition>
 
 #include "texdata.hpp"
 
@@ -62,10 +72,29 @@ typedef enum {
 class Exporter
 {
 private:
-    QList<QString> _asyncExportFileNames;
-    QList<QFuture<bool>> _asyncExports;
+    friend class SequenceWriter;
+
+    typedef bool (*WriteFunction)(const QString, const QList<TexData>, const QList<QList<int>>, int);
+
+    QThreadPool _asyncPool;
+    QMutex _asyncMutex;
+    QWaitCondition _asyncCondition;
+    size_t _asyncQueuedBytes;
+    size_t _asyncMemoryBudget;
+    bool _asyncOk;
+    std::function<void (const QString& fileName)> _asyncErrorCallback;
+    QMap<QString, QList<std::function<void ()>>> _asyncFileQueues; // exports waiting for the running export to the same file
+    int _asyncUnfinishedExports; // number of started exports that are running or queued
+
+    static WriteFunction writeFunction(FileFormat format);
 
-    static bool checkExportRequest(Exporter* asyncExporter,
+    bool startAsyncExport(const QString& fileName, WriteFunction write,
+            const QList<TexData>& dataList,
+            const QList<QList<int>>& channelsList,
+            int compressionLevel);
+    void finishAsyncExport(const QString& fileName, size_t bytes, bool ok);
+
+    static bool checkExportRequest(
             const QString& fileName, FileFormat format,
             const QList<TexData>& dataList, const QList<QList<int>>& channelsList,
             int compressionLevel,
@@ -92,6 +121,9 @@ public:
     /*! \brief Constructor */
     Exporter();
 
+    /*! \brief Destructor. Waits for all asynchronous exports to finish. */
+    ~Exporter();
+
     /*! \brief Return whether the given file format is supported (it may not be if a library was missing at build time) */
     static bool isFileFormatSupported(FileFormat format);
 
@@ -163,6 +195,11 @@ public:
      *
      * This function returns success if the export was successfully launched.
      *
+     * Exports run on a thread pool that belongs to this exporter. Exports to the same
+     * file are written in the order in which they were started. If the data of all
+     * queued exports exceeds the memory budget (see \a setAsyncExportMemoryBudget),
+     * this function blocks until enough exports have finished.
+     *
      * Call \a waitForAsyncExports to wait for all asynchronously started exports to finish.
      */
     bool asyncExportData(const QString& fileName, const TexData& data,
@@ -200,11 +237,114 @@ public:
         return exportData(this, fileName, format, dataList, channelsList, compressionLevel);
     }
 
+    /*! \brief Set the maximum number of threads for asynchronous exports.
+     * The default is the number of CPU cores. */
+    void setAsyncExportThreads(int threads);
+
+    /*! \brief Set the memory budget in bytes for the data of queued asynchronous exports.
+     * The default is 1 GiB. */
+    void setAsyncExportMemoryBudget(size_t bytes);
+
+    /*! \brief Set a function that is called when an asynchronous export fails.
+     * It is called from the export thread with the name of the affected file. */
+    void setAsyncExportErrorCallback(const std::function<void (const QString& fileName)>& callback);
+
     /*! \brief Wait for all asynchronous exports to finish. Returns true if all of them were
      * successful, and false if at least one of them failed. */
     bool waitForAsyncExports();
 };
 
+class SequenceWriterHDF5State;
+
+/**
+ * \brief Append a sequence of simulation results to a single file
+ *
+ * Unlike the \a Exporter functions, which open, write, and close the file for
+ * each export, a sequence writer keeps its file open and uses large buffered
+ * writes. Appends are executed asynchronously on a queue that belongs to the
+ * writer, so they are guaranteed to reach the file in the order in which
+ * \a append() was called, and the caller does not need to wait between frames.
+ *
+ * This works for the file formats that can hold multiple data sets:
+ * RAW, PNM, PFS, and GTA. It also works for HDF5: in this case, the file is
+ * truncated when it is opened, and each channel is stored in an extendable
+ * chunked 3D dataset (frame x height x width) to which each append adds one frame.
+ * The chunk shape can be set with \a setHDF5ChunkShape(), and the deflate level
+ * is given by the compression level of the first append.
+ *
+ * Example:
+ * \code
+ * SequenceWriter writer("pmd-result.pfs");
+ * for (...) {
+ *     simulator.simulate(t);
+ *     writer.append(simulator.getPMD());
+ * }
+ * writer.finish();
+ * \endcode
+ */
+class SequenceWriter
+{
+private:
+    QString _fileName;
+    FileFormat _format;
+    QFile _rawFile;
+    QFile _rawHeaderFile;
+    FILE* _stream;
+    std::vector<char> _streamBuffer;
+    SequenceWriterHDF5State* _hdf5;
+    int _hdf5ChunkFrames;
+    int _hdf5ChunkLines;
+    int _hdf5ChunkColumns;
+    QThreadPool _queue;
+    QList<QFuture<bool>> _pendingAppends;
+    bool _ok;
+
+    bool writeToStream(const QList<TexData>& dataList, const QList<QList<int>>& channelsList, int compressionLevel);
+
+    Q_DISABLE_COPY(SequenceWriter)
+
+public:
+    /*! \brief Constructor. Opens the file named \a fileName for appending.
+     * The file format is determined automatically from the file name
+     * if \a format is \a FileFormat_Auto.
+     * The \a bufferSize determines the size of the write buffer in bytes. */
+    SequenceWriter(const QString& fileName, FileFormat format = FileFormat_Auto,
+            size_t bufferSize = 8 * 1024 * 1024);
+
+    /*! \brief Destructor. Calls \a finish(). */
+    ~SequenceWriter();
+
+    /*! \brief Set the chunk shape of the HDF5 datasets: the number of frames,
+     * lines, and columns per chunk. A value of 0 for \a lines or \a columns means
+     * the full height or width of the data. The default is one full frame per chunk.
+     * This has to be set before the first append. */
+    void setHDF5ChunkShape(int frames, int lines = 0, int columns = 0);
+
+    /*! \brief Return whether the file is open and no error occured so far. */
+    bool isOpen() const;
+
+    /*! \brief Queue the \a data for appending to the file.
+     * Optionally select a list of \a channels to write, see \a Exporter::exportData().
+     * This function returns immediately; it returns false if the request is invalid. */
+    bool append(const TexData& data,
+            const QList<int>& channels = QList<int>(), int compressionLevel = 0)
+    {
+        return append(QList<TexData>({ data }), QList<QList<int>>({ channels }), compressionLevel);
+    }
+
+    /*! \brief Same as \a append, but for multiple data sets. */
+    bool append(const QList<TexData>& dataList,
+            const QList<QList<int>>& channelsList = QList<QList<int>>(),
+            int compressionLevel = 0);
+
+    /*! \brief Wait until all queued appends are written and flush the file.
+     * Returns true if all appends so far were successful. */
+    bool flush();
+
+    /*! \brief Flush and close the file. Returns true if all appends were successful. */
+    bool finish();
+};
+
 }
 
 #endif
@@ -23,25 +23,45 @@
  */
 
 #define _USE_MATH_DEFINES
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <cstdlib>
+
+#include <QFile>
+#include <QDir>
+#include <QStringList>
+#include <QtEndian>
+#include <QtConcurrent>
 
 #include "generator.hpp"
 #include "gl.hpp"
 
-extern "C" {
-#include "models/armadillo.h"
-#include "models/buddha.h"
-#include "models/bunny.h"
-#include "models/dragon.h"
-#include "models/teapot.h"
-}
-
 namespace CamSim {
 
 static const float pi = M_PI;
 static const float half_pi = M_PI_2;
 static const float two_pi = 2 * M_PI;
 
+// Transform \a count vectors with \a matrix, in parallel on the global thread pool
+static void transformVectors(const QMatrix4x4& matrix, const float* in, int count, float* out)
+{
+    const int chunkSize = 16384;
+    QVector<int> chunks;
+    for (int c = 0; c < count; c += chunkSize)
+        chunks.append(c);
+    QtConcurrent::blockingMap(chunks, [&](const int& first) {
+            int last = std::min(first + chunkSize, count);
+            for (int j = first; j < last; j++) {
+                QVector3D v = QVector3D(in[3 * j + 0], in[3 * j + 1], in[3 * j + 2]);
+                QVector3D w = matrix * v;
+                out[3 * j + 0] = w.x();
+                out[3 * j + 1] = w.y();
+                out[3 * j + 2] = w.z();
+            }
+        });
+}
+
 void Generator::addObjectToScene(Scene& scene, int materialIndex,
         int vertexCount,
         const float* positions,
@@ -66,27 +86,18 @@ void Generator::addObjectToScene(Scene& scene, int materialIndex,
     gl->glGenBuffers(1, &positionBuffer);
     gl->glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
     data.resize(vertexCount * 3);
-    for (int j = 0; j < vertexCount; j++) {
-        QVector3D v = QVector3D(positions[3 * j + 0], positions[3 * j + 1], positions[3 * j + 2]);
-        QVector3D w = transformationMatrix * v;
-        data[3 * j + 0] = w.x();
-        data[3 * j + 1] = w.y();
-        data[3 * j + 2] = w.z();
-    }
+    transformVectors(transformationMatrix, positions, vertexCount, data.data());
     gl->glBufferData(GL_ARRAY_BUFFER, vertexCount * 3 * sizeof(float), data.data(), GL_STATIC_DRAW);
+    shape.computeBoundingSphere(data.data(), vertexCount);
+    shape.indices = indexCount;
+    QVector<unsigned int> lodIndices = shape.computeLevelsOfDetail(data.data(), vertexCount, indices);
     gl->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
     gl->glEnableVertexAttribArray(0);
     GLuint normalBuffer;
     gl->glGenBuffers(1, &normalBuffer);
     gl->glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
     data.resize(vertexCount * 3);
-    for (int j = 0; j < vertexCount; j++) {
-        QVector3D v = QVector3D(normals[3 * j + 0], normals[3 * j + 1], normals[3 * j + 2]);
-        QVector3D w = normalMatrix * v;
-        data[3 * j + 0] = w.x();
-        data[3 * j + 1] = w.y();
-        data[3 * j + 2] = w.z();
-    }
+    transformVectors(normalMatrix, normals, vertexCount, data.data());
     gl->glBufferData(GL_ARRAY_BUFFER, vertexCount * 3 * sizeof(float), data.data(), GL_STATIC_DRAW);
     gl->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
     gl->glEnableVertexAttribArray(1);
@@ -99,8 +110,10 @@ void Generator::addObjectToScene(Scene& scene, int materialIndex,
     GLuint indexBuffer;
     gl->glGenBuffers(1, &indexBuffer);
     gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-    gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indices, GL_STATIC_DRAW);
-    shape.indices = indexCount;
+    gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER, (indexCount + lodIndices.size()) * sizeof(unsigned int), nullptr, GL_STATIC_DRAW);
+    gl->glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indexCount * sizeof(unsigned int), indices);
+    gl->glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int),
+            lodIndices.size() * sizeof(unsigned int), lodIndices.constData());
 
     Object object;
     object.shapes.append(shape);
@@ -518,74 +531,153 @@ void Generator::addTorusToScene(Scene& scene, int materialIndex,
             transformation, animation);
 }
 
-void Generator::addArmadilloToScene(Scene& scene, int materialIndex,
+/* The builtin models are stored in a compact binary format (*.mesh) and
+ * are mapped into memory only when they are actually used. All values are
+ * little endian:
+ * - header: char magic[8] = "CSMESH01"; uint32 vertexCount, indexCount, flags, reserved;
+ *   float positionOffset[3], positionScale[3]
+ * - uint16 positions[3 * vertexCount]: position = offset + q * scale
+ * - int16 normals[3 * vertexCount]: normal = q / 32767
+ * - uint16 texcoords[2 * vertexCount], only if (flags & 1): texcoord = q / 65535
+ * - padding to a multiple of 4 bytes
+ * - indices[indexCount], uint16 if (flags & 2), uint32 otherwise */
+
+static QString builtinModelFileName(const char* name)
+{
+    QStringList dirs;
+    QByteArray envDir = qgetenv("CAMSIM_MODELS_DIR");
+    if (!envDir.isEmpty())
+        dirs << QString::fromLocal8Bit(envDir);
+    dirs << CAMSIM_MODELS_INSTALL_DIR;
+#ifdef CAMSIM_MODELS_SOURCE_DIR
+    dirs << CAMSIM_MODELS_SOURCE_DIR;
+#endif
+    for (int i = 0; i < dirs.size(); i++) {
+        QString fileName = QDir(dirs[i]).filePath(QString(name) + ".mesh");
+        if (QFile::exists(fileName))
+            return fileName;
+    }
+    return QString();
+}
+
+static void addBuiltinModelToScene(Scene& scene, int materialIndex, const char* name,
         const Transformation& transformation,
         const Animation& animation)
 {
-    addObjectToScene(scene, materialIndex,
-            armadillo_vertexcount, 
-            armadillo_positions,
-            armadillo_normals,
-            armadillo_texcoords,
-            armadillo_indexcount,
-            armadillo_indices,
+    QString fileName = builtinModelFileName(name);
+    if (fileName.isEmpty()) {
+        qCritical("Cannot find builtin model %s (set CAMSIM_MODELS_DIR)", name);
+        std::exit(1);
+    }
+    QFile file(fileName);
+    const uchar* data = nullptr;
+    if (file.open(QIODevice::ReadOnly))
+        data = file.map(0, file.size());
+    const qint64 headerSize = 48;
+    if (!data || file.size() < headerSize || std::memcmp(data, "CSMESH01", 8) != 0) {
+        qCritical("%s: invalid builtin model file", qPrintable(fileName));
+        std::exit(1);
+    }
+    unsigned int vertexCount = qFromLittleEndian<quint32>(data + 8);
+    unsigned int indexCount = qFromLittleEndian<quint32>(data + 12);
+    unsigned int flags = qFromLittleEndian<quint32>(data + 16);
+    bool haveTexCoords = (flags & 1);
+    bool shortIndices = (flags & 2);
+    float offset[3], scale[3];
+    for (int k = 0; k < 3; k++) {
+        quint32 o = qFromLittleEndian<quint32>(data + 24 + 4 * k);
+        quint32 s = qFromLittleEndian<quint32>(data + 36 + 4 * k);
+        std::memcpy(offset + k, &o, sizeof(float));
+        std::memcpy(scale + k, &s, sizeof(float));
+    }
+    qint64 positionsOffset = headerSize;
+    qint64 normalsOffset = positionsOffset + 3 * 2 * qint64(vertexCount);
+    qint64 texCoordsOffset = normalsOffset + 3 * 2 * qint64(vertexCount);
+    qint64 indicesOffset = texCoordsOffset + (haveTexCoords ? 2 * 2 * qint64(vertexCount) : 0);
+    indicesOffset = (indicesOffset + 3) / 4 * 4;
+    if (file.size() < indicesOffset + (shortIndices ? 2 : 4) * qint64(indexCount)) {
+        qCritical("%s: invalid builtin model file", qPrintable(fileName));
+        std::exit(1);
+    }
+
+    QVector<float> positions(3 * vertexCount);
+    QVector<float> normals(3 * vertexCount);
+    QVector<float> texCoords(2 * vertexCount, 0.0f);
+    QVector<unsigned int> indices(indexCount);
+    for (unsigned int j = 0; j < vertexCount; j++) {
+        for (int k = 0; k < 3; k++) {
+            quint16 p = qFromLittleEndian<quint16>(data + positionsOffset + 2 * (3 * j + k));
+            qint16 n = qFromLittleEndian<qint16>(data + normalsOffset + 2 * (3 * j + k));
+            positions[3 * j + k] = offset[k] + p * scale[k];
+            normals[3 * j + k] = std::max(n / 32767.0f, -1.0f);
+        }
+    }
+    if (haveTexCoords) {
+        for (unsigned int j = 0; j < 2 * vertexCount; j++)
+            texCoords[j] = qFromLittleEndian<quint16>(data + texCoordsOffset + 2 * j) / 65535.0f;
+    }
+    for (unsigned int j = 0; j < indexCount; j++) {
+        indices[j] = (shortIndices
+                ? qFromLittleEndian<quint16>(data + indicesOffset + 2 * j)
+                : qFromLittleEndian<quint32>(data + indicesOffset + 4 * j));
+    }
+    file.unmap(const_cast<uchar*>(data));
+
+    Generator::addObjectToScene(scene, materialIndex,
+            positions, normals, texCoords, indices,
             transformation, animation);
 }
 
+void Generator::addArmadilloToScene(Scene& scene, int materialIndex,
+        const Transformation& transformation,
+        const Animation& animation)
+{
+    addBuiltinModelToScene(scene, materialIndex, "armadillo", transformation, animation);
+}
+
 void Generator::addBuddhaToScene(Scene& scene, int materialIndex,
         const Transformation& transformation,
         const Animation& animation)
 {
-    addObjectToScene(scene, materialIndex,
-            buddha_vertexcount, 
-            buddha_positions,
-            buddha_normals,
-            buddha_texcoords,
-            buddha_indexcount,
-            buddha_indices,
-            transformation, animation);
+    addBuiltinModelToScene(scene, materialIndex, "buddha", transformation, animation);
 }
 
 void Generator::addBunnyToScene(Scene& scene, int materialIndex,
         const Transformation& transformation,
         const Animation& animation)
 {
-    addObjectToScene(scene, materialIndex,
-            bunny_vertexcount, 
-            bunny_positions,
-            bunny_normals,
-            bunny_texcoords,
-            bunny_indexcount,
-            bunny_indices,
-            transformation, animation);
+    addBuiltinModelToScene(scene, materialIndex, "bunny", transformation, animation);
 }
 
 void Generator::addDragonToScene(Scene& scene, int materialIndex,
         const Transformation& transformation,
         const Animation& animation)
 {
-    addObjectToScene(scene, materialIndex,
-            dragon_vertexcount, 
-            dragon_positions,
-            dragon_normals,
-            dragon_texcoords,
-            dragon_indexcount,
-            dragon_indices,
-            transformation, animation);
+    addBuiltinModelToScene(scene, materialIndex, "dragon", transformation, animation);
 }
 
 void Generator::addTeapotToScene(Scene& scene, int materialIndex,
         const Transformation& transformation,
         const Animation& animation)
 {
-    addObjectToScene(scene, materialIndex,
-            teapot_vertexcount, 
-            teapot_positions,
-            teapot_normals,
-            teapot_texcoords,
-            teapot_indexcount,
-            teapot_indices,
-            transformation, animation);
+    addBuiltinModelToScene(scene, materialIndex, "teapot", transformation, animation);
+}
+
+void Generator::instantiateLastObject(Scene& scene, const QList<Animation>& animations)
+{
+    Q_ASSERT(scene.objects.size() > 0);
+    // If the last object is the last member of a run of instances, remove it from that run
+    int last = scene.objects.size() - 1;
+    for (int i = last; i >= 0; i--) {
+        if (scene.objects[i].instances > 1) {
+            if (i + scene.objects[i].instances - 1 >= last)
+                scene.objects[i].instances--;
+            break;
+        }
+    }
+    Object object = scene.objects.takeLast();
+    scene.objectAnimations.removeLast();
+    scene.addInstancedObject(object, animations);
 }
 
 }
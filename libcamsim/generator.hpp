@@ -34,6 +34,12 @@ namespace CamSim {
 
 /**
  * \brief Generates basic objects to populate a scene
+ *
+ * The builtin models (armadillo, buddha, bunny, dragon, teapot) are loaded on
+ * demand from compact binary files that are installed alongside the library.
+ * The environment variable CAMSIM_MODELS_DIR can be set to override their location.
+ * Uninstalled builds can find them in the source tree if configured with the
+ * CMake option CAMSIM_MODELS_FROM_SOURCE_DIR.
  */
 class Generator
 {
@@ -189,6 +195,15 @@ public:
     static void addTeapotToScene(Scene& scene, int materialIndex,
             const Transformation& transformation,
             const Animation& animation = Animation());
+
+    /*! \brief Replaces the last object of a scene, e.g. one that was just added by one of
+     * the functions above, by one instance for each of the given \a animations.
+     * The instances share the geometry of the object, so that repeated objects
+     * need neither additional memory nor additional draw calls. See \a Scene::addInstancedObject().
+     * If the last object is itself the last instance of an earlier run of instances, it is
+     * removed from that run first, and the new instances form a run of their own.
+     */
+    static void instantiateLastObject(Scene& scene, const QList<Animation>& animations);
 };
 
 }
@@ -59,6 +59,32 @@ void glCheck(const char* callingFunction, const char* file, int line)
     }
 }
 
+bool getGlBindlessTextureFunctionsFromCurrentContext(GLBindlessTextureFunctions* funcs)
+{
+    QOpenGLContext* ctx = QOpenGLContext::currentContext();
+    if (!ctx || !ctx->hasExtension("GL_ARB_bindless_texture"))
+        return false;
+    funcs->glGetTextureSamplerHandleARB = reinterpret_cast<GLuint64 (QOPENGLF_APIENTRYP)(GLuint, GLuint)>(
+            ctx->getProcAddress("glGetTextureSamplerHandleARB"));
+    funcs->glMakeTextureHandleResidentARB = reinterpret_cast<void (QOPENGLF_APIENTRYP)(GLuint64)>(
+            ctx->getProcAddress("glMakeTextureHandleResidentARB"));
+    funcs->glMakeTextureHandleNonResidentARB = reinterpret_cast<void (QOPENGLF_APIENTRYP)(GLuint64)>(
+            ctx->getProcAddress("glMakeTextureHandleNonResidentARB"));
+    return (funcs->glGetTextureSamplerHandleARB
+            && funcs->glMakeTextureHandleResidentARB
+            && funcs->glMakeTextureHandleNonResidentARB);
+}
+
+bool getGlSampleLocationsFunctionsFromCurrentContext(GLSampleLocationsFunctions* funcs)
+{
+    QOpenGLContext* ctx = QOpenGLContext::currentContext();
+    if (!ctx || !ctx->hasExtension("GL_ARB_sample_locations"))
+        return false;
+    funcs->glNamedFramebufferSampleLocationsfvARB = reinterpret_cast<void (QOPENGLF_APIENTRYP)(GLuint, GLuint, GLsizei, const GLfloat*)>(
+            ctx->getProcAddress("glNamedFramebufferSampleLocationsfvARB"));
+    return bool(funcs->glNamedFramebufferSampleLocationsfvARB);
+}
+
 size_t glTypeSize(GLenum type)
 {
     size_t s = 0;
@@ -69,6 +95,7 @@ size_t glTypeSize(GLenum type)
         break;
     case GL_UNSIGNED_SHORT:
     case GL_SHORT:
+    case GL_HALF_FLOAT:
         s = 2;
         break;
     case GL_UNSIGNED_INT:
@@ -45,6 +45,36 @@ QOpenGLFunctions_4_5_Core* getGlFunctionsFromCurrentContext(const char* callingF
 
 void glCheck(const char* callingFunction, const char* file, int line);
 
+/*! \brief Entry points of the ARB_bindless_texture extension, which is not part
+ * of the core profile. */
+class GLBindlessTextureFunctions
+{
+public:
+    GLuint64 (QOPENGLF_APIENTRYP glGetTextureSamplerHandleARB)(GLuint texture, GLuint sampler);
+    void (QOPENGLF_APIENTRYP glMakeTextureHandleResidentARB)(GLuint64 handle);
+    void (QOPENGLF_APIENTRYP glMakeTextureHandleNonResidentARB)(GLuint64 handle);
+};
+
+/*! \brief Get the ARB_bindless_texture entry points from the current context.
+ * Returns false if the extension is not available. */
+bool getGlBindlessTextureFunctionsFromCurrentContext(GLBindlessTextureFunctions* funcs);
+
+#ifndef GL_FRAMEBUFFER_PROGRAMMABLE_SAMPLE_LOCATIONS_ARB
+# define GL_FRAMEBUFFER_PROGRAMMABLE_SAMPLE_LOCATIONS_ARB 0x9342
+#endif
+
+/*! \brief Entry points of the ARB_sample_locations extension, which is not part
+ * of the core profile. */
+class GLSampleLocationsFunctions
+{
+public:
+    void (QOPENGLF_APIENTRYP glNamedFramebufferSampleLocationsfvARB)(GLuint framebuffer, GLuint start, GLsizei count, const GLfloat* v);
+};
+
+/*! \brief Get the ARB_sample_locations entry points from the current context.
+ * Returns false if the extension is not available. */
+bool getGlSampleLocationsFunctionsFromCurrentContext(GLSampleLocationsFunctions* funcs);
+
 #ifdef QT_NO_DEBUG
 # define ASSERT_GLCHECK() /* nothing */
 #else
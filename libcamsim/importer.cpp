@@ -24,13 +24,23 @@
 
 #include "importer.hpp"
 
+#include <cstring>
+#include <algorithm>
+
 #include <QFileInfo>
 #include <QDir>
 #include <QImage>
 #include <QMap>
+#include <QStringList>
+#include <QFile>
+#include <QSaveFile>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QtConcurrent>
 
 #ifdef HAVE_ASSIMP
 # include <assimp/DefaultLogger.hpp>
+# include <assimp/DefaultIOSystem.h>
 # include <assimp/Importer.hpp>
 # include <assimp/scene.h>
 # include <assimp/postprocess.h>
@@ -41,15 +51,233 @@
 
 namespace CamSim {
 
+/* The import cache is a binary bundle that contains everything that
+ * addLightsToScene() and addObjectToScene() need, in the form in which it is
+ * uploaded to the GPU: transformed vertex data, indices, materials, and
+ * textures including all their mipmap levels. It is memory-mapped when used.
+ * Cache files are only meant for the machine that wrote them, so all values
+ * are stored in host byte order.
+ *
+ * Layout (all records are padded to multiples of 4 bytes):
+ * - CacheHeader
+ * - dependencyCount times: CacheDependency, then the UTF-8 file name; these are the
+ *   other files that the import read (e.g. material libraries and textures), with
+ *   their size and modification time when the cache was written
+ * - CacheLight[lightCount], with the values as stored in the source file
+ * - textureCount times: CacheTexture, then levels times: CacheTextureLevel and texel data
+ * - CacheMaterial[materialCount]
+ * - shapeCount times: CacheShape, then float positions[3 * vertexCount],
+ *   float normals[3 * vertexCount], float texcoords[2 * vertexCount],
+ *   unsigned int indices[indexCount], CacheLevelOfDetail[lodCount],
+ *   unsigned int lodIndices[lodIndexCount]; vertex data is transformed with
+ *   CacheHeader::transformation. */
+
+static const char cacheMagic[8] = { 'C', 'S', 'I', 'M', 'P', 'C', '0', '3' };
+
+struct CacheHeader {
+    char magic[8];
+    float transformation[16];
+    quint32 lightCount;
+    quint32 textureCount;
+    quint32 materialCount;
+    quint32 shapeCount;
+    quint32 dependencyCount;
+};
+
+struct CacheDependency {
+    qint64 size;            // -1 if the file did not exist
+    qint64 lastModified;    // in milliseconds since the epoch
+    quint32 nameSize;
+    quint32 reserved;
+};
+
+// Get the identity of a file as stored in CacheDependency
+static void getFileIdentity(const QString& fileName, qint64* size, qint64* lastModified)
+{
+    QFileInfo fileInfo(fileName);
+    *size = fileInfo.exists() ? fileInfo.size() : -1;
+    *lastModified = fileInfo.exists() ? fileInfo.lastModified().toMSecsSinceEpoch() : -1;
+}
+
+#ifdef HAVE_ASSIMP
+// An IO system that remembers all files that libassimp opens, e.g. material libraries
+class RecordingIOSystem : public Assimp::DefaultIOSystem
+{
+private:
+    QStringList* _fileNames;
+
+public:
+    RecordingIOSystem(QStringList* fileNames) : _fileNames(fileNames) {}
+
+    Assimp::IOStream* Open(const char* file, const char* mode = "rb") override
+    {
+        Assimp::IOStream* stream = Assimp::DefaultIOSystem::Open(file, mode);
+        QString fileName = QFileInfo(QString::fromLocal8Bit(file)).absoluteFilePath();
+        if (stream && !_fileNames->contains(fileName))
+            _fileNames->append(fileName);
+        return stream;
+    }
+};
+#endif
+
+struct CacheLight {
+    quint32 type;
+    float innerConeAngle;
+    float outerConeAngle;
+    float position[3];
+    float direction[3];
+    float color[3];
+    float attenuation[3];
+};
+
+struct CacheTexture {
+    quint32 scalar;
+    qint32 wrapS;
+    qint32 wrapT;
+    quint32 levels;
+};
+
+struct CacheTextureLevel {
+    quint32 width;
+    quint32 height;
+};
+
+struct CacheMaterial {
+    quint32 isTwoSided;
+    float bumpScaling;
+    float opacity;
+    float ambient[3];
+    float diffuse[3];
+    float specular[3];
+    float emissive[3];
+    float shininess;
+    qint32 textures[9]; // indices into the cached textures, or -1
+};
+
+struct CacheShape {
+    quint32 materialIndex;
+    quint32 vertexCount;
+    quint32 indexCount;
+    float boundingSphere[4];
+    quint32 lodCount;
+    quint32 lodIndexCount;
+};
+
+struct CacheLevelOfDetail {
+    quint32 firstIndex;
+    quint32 indices;
+    float error;
+};
+
 class ImporterInternals
 {
 public:
 #ifdef HAVE_ASSIMP
     Assimp::Importer importer;
     const aiScene* scene;
-#else
-    int dummy;
+    QStringList readFileNames;  // the files that libassimp read during the last import
 #endif
+    QString cacheFileName;      // cache file to write on the next import with libassimp
+    QFile cacheFile;
+    const uchar* cache;         // mapped cache file, or nullptr
+    qint64 cacheSize;
+    const CacheHeader* cacheHeader;
+    const CacheLight* cacheLights;
+    QVector<const CacheTexture*> cacheTextures;
+    const CacheMaterial* cacheMaterials;
+    QVector<const CacheShape*> cacheShapes;
+
+    ImporterInternals() : cache(nullptr), cacheSize(0) {}
+
+    // Return a pointer to the next \a bytes of the cache at \a offset, and advance the offset
+    const uchar* cacheData(qint64& offset, qint64 bytes) const
+    {
+        if (bytes < 0 || offset + bytes > cacheSize)
+            return nullptr;
+        const uchar* p = cache + offset;
+        offset += (bytes + 3) / 4 * 4;
+        return p;
+    }
+
+    void closeCache()
+    {
+        if (cache)
+            cacheFile.unmap(const_cast<uchar*>(cache));
+        cacheFile.close();
+        cache = nullptr;
+        cacheSize = 0;
+        cacheTextures.clear();
+        cacheShapes.clear();
+    }
+
+    bool openCache(const QString& fileName)
+    {
+        closeCache();
+        cacheFile.setFileName(fileName);
+        if (!cacheFile.open(QIODevice::ReadOnly))
+            return false;
+        cacheSize = cacheFile.size();
+        cache = cacheFile.map(0, cacheSize);
+        bool ok = (cache != nullptr);
+        qint64 offset = 0;
+        if (ok) {
+            cacheHeader = reinterpret_cast<const CacheHeader*>(cacheData(offset, sizeof(CacheHeader)));
+            ok = (cacheHeader && std::memcmp(cacheHeader->magic, cacheMagic, sizeof(cacheMagic)) == 0);
+        }
+        for (quint32 i = 0; ok && i < cacheHeader->dependencyCount; i++) {
+            // (records are only aligned to 4 bytes, so copy them)
+            const uchar* d = cacheData(offset, sizeof(CacheDependency));
+            CacheDependency cd;
+            if (d)
+                std::memcpy(&cd, d, sizeof(CacheDependency));
+            const uchar* name = (d ? cacheData(offset, cd.nameSize) : nullptr);
+            ok = (name != nullptr);
+            if (ok) {
+                QString dependency = QString::fromUtf8(reinterpret_cast<const char*>(name), cd.nameSize);
+                qint64 size, lastModified;
+                getFileIdentity(dependency, &size, &lastModified);
+                if (size != cd.size || lastModified != cd.lastModified) {
+                    qInfo("%s: ignoring outdated import cache file because %s changed",
+                            qPrintable(fileName), qPrintable(dependency));
+                    closeCache();
+                    return false;
+                }
+            }
+        }
+        if (ok) {
+            cacheLights = reinterpret_cast<const CacheLight*>(cacheData(offset,
+                        qint64(cacheHeader->lightCount) * sizeof(CacheLight)));
+            ok = (cacheLights != nullptr);
+        }
+        for (quint32 i = 0; ok && i < cacheHeader->textureCount; i++) {
+            const CacheTexture* t = reinterpret_cast<const CacheTexture*>(cacheData(offset, sizeof(CacheTexture)));
+            ok = (t && t->levels >= 1 && t->levels <= 32);
+            for (quint32 l = 0; ok && l < t->levels; l++) {
+                const CacheTextureLevel* tl = reinterpret_cast<const CacheTextureLevel*>(
+                        cacheData(offset, sizeof(CacheTextureLevel)));
+                ok = (tl && cacheData(offset, qint64(tl->width) * tl->height * (t->scalar ? 1 : 4)));
+            }
+            cacheTextures.append(t);
+        }
+        if (ok) {
+            cacheMaterials = reinterpret_cast<const CacheMaterial*>(cacheData(offset,
+                        qint64(cacheHeader->materialCount) * sizeof(CacheMaterial)));
+            ok = (cacheMaterials != nullptr);
+        }
+        for (quint32 i = 0; ok && i < cacheHeader->shapeCount; i++) {
+            const CacheShape* s = reinterpret_cast<const CacheShape*>(cacheData(offset, sizeof(CacheShape)));
+            ok = (s && cacheData(offset, qint64(s->vertexCount) * 8 * sizeof(float))
+                    && cacheData(offset, qint64(s->indexCount) * sizeof(unsigned int))
+                    && cacheData(offset, qint64(s->lodCount) * sizeof(CacheLevelOfDetail))
+                    && cacheData(offset, qint64(s->lodIndexCount) * sizeof(unsigned int)));
+            cacheShapes.append(s);
+        }
+        if (!ok) {
+            qWarning("%s: ignoring invalid import cache file", qPrintable(fileName));
+            closeCache();
+        }
+        return ok;
+    }
 };
 
 Importer::Importer()
@@ -59,14 +287,42 @@ Importer::Importer()
 
 Importer::~Importer()
 {
+    _internals->closeCache();
     delete _internals;
 }
 
+static QString cacheFileNameFor(const QString& cacheDirectory, const QString& fileName)
+{
+    // Cache entries are keyed by the source file identity; if the source
+    // file changes, a new entry is created.
+    QFileInfo fileInfo(fileName);
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(fileInfo.absoluteFilePath().toUtf8());
+    hash.addData(QByteArray::number(fileInfo.size()));
+    hash.addData(QByteArray::number(fileInfo.lastModified().toMSecsSinceEpoch()));
+    hash.addData(cacheMagic, sizeof(cacheMagic));
+    return QDir(cacheDirectory).filePath(QString(hash.result().toHex()) + ".cache");
+}
+
 bool Importer::import(const QString& fileName)
 {
+    _internals->closeCache();
+    _internals->cacheFileName = QString();
+    if (!_cacheDirectory.isEmpty()) {
+        QString cacheFileName = cacheFileNameFor(_cacheDirectory, fileName);
+        if (QFile::exists(cacheFileName) && _internals->openCache(cacheFileName)) {
+            qInfo("%s: using import cache %s", qPrintable(fileName), qPrintable(cacheFileName));
+            _fileName = fileName;
+            return true;
+        }
+        _internals->cacheFileName = cacheFileName;
+    }
 #ifdef HAVE_ASSIMP
     qInfo("%s: starting import...", qPrintable(fileName));
     Assimp::DefaultLogger::create("", Assimp::Logger::NORMAL, aiDefaultLogStream_STDERR);
+    _internals->readFileNames.clear();
+    // (the importer takes ownership of the IO system)
+    _internals->importer.SetIOHandler(new RecordingIOSystem(&_internals->readFileNames));
     _internals->importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS,
             aiComponent_TANGENTS_AND_BITANGENTS | aiComponent_COLORS |
             aiComponent_ANIMATIONS | aiComponent_CAMERAS);
@@ -108,6 +364,8 @@ void Importer::addLightsToScene(Scene& scene) const
 
 int Importer::lightCount() const
 {
+    if (_internals->cache)
+        return _internals->cacheHeader->lightCount;
 #ifdef HAVE_ASSIMP
     return _internals->scene->mNumLights;
 #else
@@ -117,6 +375,25 @@ int Importer::lightCount() const
 
 void Importer::addLightToScene(int lightSourceIndex, Scene& scene) const
 {
+    if (_internals->cache) {
+        const CacheLight& l = _internals->cacheLights[lightSourceIndex];
+        Light light;
+        light.type = static_cast<LightType>(l.type);
+        light.innerConeAngle = l.innerConeAngle;
+        light.outerConeAngle = l.outerConeAngle;
+        light.isRelativeToCamera = false;
+        light.position = _transformationMatrix
+            * QVector3D(l.position[0], l.position[1], l.position[2]);
+        light.direction = (_transformationMatrix
+                * QVector4D(l.direction[0], l.direction[1], l.direction[2], 0.0f)).toVector3D();
+        light.color = QVector3D(l.color[0], l.color[1], l.color[2]);
+        light.attenuationConstant = l.attenuation[0];
+        light.attenuationLinear = l.attenuation[1];
+        light.attenuationQuadratic = l.attenuation[2];
+        scene.lights.append(light);
+        scene.lightAnimations.append(Animation());
+        return;
+    }
 #ifdef HAVE_ASSIMP
     Light light;
 
@@ -156,76 +433,411 @@ void Importer::addLightToScene(int lightSourceIndex, Scene& scene) const
 }
 
 #ifdef HAVE_ASSIMP
-static unsigned int createTex(
-        const QString& baseDir,
-        QMap<QString, unsigned int>& texturemap,
-        const aiMaterial* m, aiTextureType t, unsigned int i, bool scalar)
+static QString texFileName(const QString& baseDir,
+        const aiMaterial* m, aiTextureType t, unsigned int i,
+        aiTextureMapMode* mapmode = nullptr)
 {
-    auto gl = getGlFunctionsFromCurrentContext(Q_FUNC_INFO);
-
     aiString path;
-    aiTextureMapMode mapmode[3] = { aiTextureMapMode_Wrap, aiTextureMapMode_Wrap, aiTextureMapMode_Wrap };
-    m->GetTexture(t, i, &path, NULL, NULL, NULL, NULL, mapmode);
+    aiTextureMapMode tmpmapmode[3] = { aiTextureMapMode_Wrap, aiTextureMapMode_Wrap, aiTextureMapMode_Wrap };
+    m->GetTexture(t, i, &path, NULL, NULL, NULL, NULL, tmpmapmode);
+    if (mapmode)
+        *mapmode = tmpmapmode[0];
 
     QString fileName = baseDir + '/' + path.C_Str();
     fileName.replace('\\', '/');
+    return fileName;
+}
+
+// The CPU stage of texture creation: decode the image.
+// This is safe to run in any thread.
+static QImage loadTexImage(const QString& fileName)
+{
+    QImage img;
+    if (img.load(fileName)) {
+        img = img.mirrored(false, true);
+        img = img.convertToFormat(QImage::Format_RGBA8888);
+    }
+    return img;
+}
 
+// The GL stage of texture creation: upload the decoded image.
+static unsigned int uploadTex(const QImage& img, aiTextureMapMode mapmode, bool scalar)
+{
+    auto gl = getGlFunctionsFromCurrentContext(Q_FUNC_INFO);
+
+    // Using Qt bindTexture() does not work for some reason, maybe it's
+    // because we use a core context. So we do it ourselves.
     unsigned int tex = 0;
-    auto it = texturemap.find(fileName);
-    if (it != texturemap.end()) {
-        tex = it.value();
-    } else {
-        QImage img;
-        if (!img.load(fileName)) {
-            qWarning("%s: cannot load texture, ignoring it", qPrintable(fileName));
-        } else {
-            // Using Qt bindTexture() does not work for some reason, maybe it's
-            // because we use a core context. So we do it ourselves.
-            img = img.mirrored(false, true);
-            img = img.convertToFormat(QImage::Format_RGBA8888);
-            gl->glGenTextures(1, &tex);
-            gl->glBindTexture(GL_TEXTURE_2D, tex);
-            gl->glTexImage2D(GL_TEXTURE_2D, 0, scalar ? GL_R8 : GL_RGBA8,
-                    img.width(), img.height(), 0,
-                    GL_RGBA, GL_UNSIGNED_BYTE, img.constBits());
-            gl->glGenerateMipmap(GL_TEXTURE_2D);
-            gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-            switch (mapmode[0]) {
-            case aiTextureMapMode_Wrap:
-                gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-                gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-                break;
-            case aiTextureMapMode_Clamp:
-                gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-                gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-                break;
-            case aiTextureMapMode_Decal:
-                gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-                gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-                break;
-            case aiTextureMapMode_Mirror:
-                gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-                gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
-                break;
-            default:
-                break;
-            }
-        }
-        texturemap.insert(fileName, tex);
+    gl->glGenTextures(1, &tex);
+    gl->glBindTexture(GL_TEXTURE_2D, tex);
+    gl->glTexImage2D(GL_TEXTURE_2D, 0, scalar ? GL_R8 : GL_RGBA8,
+            img.width(), img.height(), 0,
+            GL_RGBA, GL_UNSIGNED_BYTE, img.constBits());
+    gl->glGenerateMipmap(GL_TEXTURE_2D);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    switch (mapmode) {
+    case aiTextureMapMode_Wrap:
+        gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        break;
+    case aiTextureMapMode_Clamp:
+        gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        break;
+    case aiTextureMapMode_Decal:
+        gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        break;
+    case aiTextureMapMode_Mirror:
+        gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
+        gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
+        break;
+    default:
+        break;
     }
     return tex;
 }
+
+// The texture types that we import, in the order of the ImportedMaterial::textures entries
+static const aiTextureType importedTextureTypes[9] = {
+    aiTextureType_AMBIENT, aiTextureType_DIFFUSE, aiTextureType_SPECULAR,
+    aiTextureType_EMISSIVE, aiTextureType_SHININESS, aiTextureType_LIGHTMAP,
+    aiTextureType_HEIGHT, aiTextureType_NORMALS, aiTextureType_OPACITY
+};
+static const bool importedTextureIsScalar[9] = {
+    false, false, false,
+    false, true, true,
+    true, false, true
+};
+
+struct TextureRequest {
+    QString fileName;
+    aiTextureMapMode mapmode;
+    bool scalar;
+    QImage img;
+};
+
+// The CPU stage of shape creation: transform the vertex data and convert the indices.
+// This is safe to run in any thread.
+struct MeshData {
+    Shape shape;
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<float> texcoords;
+    std::vector<unsigned int> indices;
+    QVector<unsigned int> lodIndices;
+};
+
+static void prepareMesh(const aiMesh* m,
+        const QMatrix4x4& transformationMatrix, const QMatrix4x4& normalMatrix,
+        MeshData& md)
+{
+    md.shape.materialIndex = m->mMaterialIndex;
+    md.positions.resize(m->mNumVertices * 3);
+    for (unsigned int j = 0; j < m->mNumVertices; j++) {
+        QVector3D v = QVector3D(m->mVertices[j].x, m->mVertices[j].y, m->mVertices[j].z);
+        QVector3D w = transformationMatrix * v;
+        md.positions[3 * j + 0] = w.x();
+        md.positions[3 * j + 1] = w.y();
+        md.positions[3 * j + 2] = w.z();
+    }
+    md.shape.computeBoundingSphere(md.positions.data(), m->mNumVertices);
+    md.normals.resize(m->mNumVertices * 3);
+    for (unsigned int j = 0; j < m->mNumVertices; j++) {
+        QVector3D v = QVector3D(m->mNormals[j].x, m->mNormals[j].y, m->mNormals[j].z);
+        QVector3D w = normalMatrix * v;
+        md.normals[3 * j + 0] = w.x();
+        md.normals[3 * j + 1] = w.y();
+        md.normals[3 * j + 2] = w.z();
+    }
+    md.texcoords.resize(m->mNumVertices * 2, 0.0f);
+    if (m->mTextureCoords[0]) {
+        for (unsigned int j = 0; j < m->mNumVertices; j++) {
+            md.texcoords[2 * j + 0] = m->mTextureCoords[0][j][0];
+            md.texcoords[2 * j + 1] = m->mTextureCoords[0][j][1];
+        }
+    }
+    md.indices.resize(m->mNumFaces * 3);
+    for (unsigned int j = 0; j < m->mNumFaces; j++) {
+        md.indices[3 * j + 0] = m->mFaces[j].mIndices[0];
+        md.indices[3 * j + 1] = m->mFaces[j].mIndices[1];
+        md.indices[3 * j + 2] = m->mFaces[j].mIndices[2];
+    }
+    md.shape.indices = m->mNumFaces * 3;
+    md.lodIndices = md.shape.computeLevelsOfDetail(md.positions.data(), m->mNumVertices, md.indices.data());
+}
+#endif
+
+#ifdef HAVE_ASSIMP
+template<typename T> static void appendToCache(QByteArray& cache, const T* data, qint64 n = 1)
+{
+    cache.append(reinterpret_cast<const char*>(data), n * sizeof(T));
+    while (cache.size() % 4 != 0)
+        cache.append('\0');
+}
+
+static void appendTexToCache(QByteArray& cache, unsigned int tex)
+{
+    auto gl = getGlFunctionsFromCurrentContext(Q_FUNC_INFO);
+
+    gl->glBindTexture(GL_TEXTURE_2D, tex);
+    GLint internalFormat, wrapS, wrapT;
+    gl->glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+    gl->glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, &wrapS);
+    gl->glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, &wrapT);
+    QVector<CacheTextureLevel> levels;
+    for (int l = 0; l < 32; l++) {
+        GLint w = 0, h = 0;
+        gl->glGetTexLevelParameteriv(GL_TEXTURE_2D, l, GL_TEXTURE_WIDTH, &w);
+        gl->glGetTexLevelParameteriv(GL_TEXTURE_2D, l, GL_TEXTURE_HEIGHT, &h);
+        if (w <= 0 || h <= 0)
+            break;
+        CacheTextureLevel tl = { quint32(w), quint32(h) };
+        levels.append(tl);
+    }
+    CacheTexture t;
+    t.scalar = (internalFormat == GL_R8);
+    t.wrapS = wrapS;
+    t.wrapT = wrapT;
+    t.levels = levels.size();
+    appendToCache(cache, &t);
+    std::vector<unsigned char> texels;
+    gl->glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (int l = 0; l < levels.size(); l++) {
+        appendToCache(cache, &(levels[l]));
+        texels.resize(size_t(levels[l].width) * levels[l].height * (t.scalar ? 1 : 4));
+        gl->glGetTexImage(GL_TEXTURE_2D, l, t.scalar ? GL_RED : GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+        appendToCache(cache, texels.data(), texels.size());
+    }
+    gl->glPixelStorei(GL_PACK_ALIGNMENT, 4);
+}
 #endif
 
+static unsigned int createTexFromCache(const ImporterInternals* internals, int index)
+{
+    auto gl = getGlFunctionsFromCurrentContext(Q_FUNC_INFO);
+
+    const CacheTexture* t = internals->cacheTextures[index];
+    qint64 offset = reinterpret_cast<const uchar*>(t) - internals->cache;
+    internals->cacheData(offset, sizeof(CacheTexture));
+    unsigned int tex;
+    gl->glGenTextures(1, &tex);
+    gl->glBindTexture(GL_TEXTURE_2D, tex);
+    gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (quint32 l = 0; l < t->levels; l++) {
+        const CacheTextureLevel* tl = reinterpret_cast<const CacheTextureLevel*>(
+                internals->cacheData(offset, sizeof(CacheTextureLevel)));
+        const uchar* texels = internals->cacheData(offset, qint64(tl->width) * tl->height * (t->scalar ? 1 : 4));
+        gl->glTexImage2D(GL_TEXTURE_2D, l, t->scalar ? GL_R8 : GL_RGBA8,
+                tl->width, tl->height, 0,
+                t->scalar ? GL_RED : GL_RGBA, GL_UNSIGNED_BYTE, texels);
+    }
+    gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, t->levels - 1);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, t->wrapS);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, t->wrapT);
+    return tex;
+}
+
+static void addCachedObjectToScene(const ImporterInternals* internals,
+        const QMatrix4x4& transformationMatrix, Scene& scene)
+{
+    auto gl = getGlFunctionsFromCurrentContext(Q_FUNC_INFO);
+    const CacheHeader* header = internals->cacheHeader;
+
+    /* first the textures and materials */
+    QVector<unsigned int> textures(header->textureCount);
+    for (int i = 0; i < textures.size(); i++)
+        textures[i] = createTexFromCache(internals, i);
+    scene.materials.reserve(scene.materials.size() + header->materialCount);
+    for (unsigned int i = 0; i < header->materialCount; i++) {
+        const CacheMaterial& m = internals->cacheMaterials[i];
+        unsigned int tex[9];
+        for (int k = 0; k < 9; k++)
+            tex[k] = (m.textures[k] >= 0 && m.textures[k] < textures.size() ? textures[m.textures[k]] : 0);
+        Material mat;
+        mat.type = Phong;
+        mat.isTwoSided = m.isTwoSided;
+        mat.bumpScaling = m.bumpScaling;
+        mat.opacity = m.opacity;
+        mat.ambient = QVector3D(m.ambient[0], m.ambient[1], m.ambient[2]);
+        mat.diffuse = QVector3D(m.diffuse[0], m.diffuse[1], m.diffuse[2]);
+        mat.specular = QVector3D(m.specular[0], m.specular[1], m.specular[2]);
+        mat.emissive = QVector3D(m.emissive[0], m.emissive[1], m.emissive[2]);
+        mat.shininess = m.shininess;
+        mat.ambientTex = tex[0];
+        mat.diffuseTex = tex[1];
+        mat.specularTex = tex[2];
+        mat.emissiveTex = tex[3];
+        mat.shininessTex = tex[4];
+        mat.lightnessTex = tex[5];
+        mat.bumpTex = tex[6];
+        mat.normalTex = tex[7];
+        mat.opacityTex = tex[8];
+        scene.materials.append(mat);
+    }
+
+    /* then the shapes; the vertex data can be uploaded as is unless the
+     * transformation matrix differs from the one used when writing the cache */
+    QMatrix4x4 cacheMatrix;
+    std::memcpy(cacheMatrix.data(), header->transformation, 16 * sizeof(float));
+    bool retransform = !(cacheMatrix == transformationMatrix);
+    QMatrix4x4 matrix = transformationMatrix * cacheMatrix.inverted();
+    QMatrix4x4 normalMatrix = QMatrix4x4(matrix.normalMatrix());
+    float errorScale = std::max(std::max(matrix.column(0).toVector3D().length(),
+                matrix.column(1).toVector3D().length()), matrix.column(2).toVector3D().length());
+    std::vector<float> positionData, normalData;
+    Object object;
+    object.shapes.reserve(header->shapeCount);
+    for (int i = 0; i < internals->cacheShapes.size(); i++) {
+        const CacheShape* cs = internals->cacheShapes[i];
+        qint64 offset = reinterpret_cast<const uchar*>(cs) - internals->cache;
+        internals->cacheData(offset, sizeof(CacheShape));
+        const float* positions = reinterpret_cast<const float*>(
+                internals->cacheData(offset, qint64(cs->vertexCount) * 3 * sizeof(float)));
+        const float* normals = reinterpret_cast<const float*>(
+                internals->cacheData(offset, qint64(cs->vertexCount) * 3 * sizeof(float)));
+        const float* texcoords = reinterpret_cast<const float*>(
+                internals->cacheData(offset, qint64(cs->vertexCount) * 2 * sizeof(float)));
+        const unsigned int* indices = reinterpret_cast<const unsigned int*>(
+                internals->cacheData(offset, qint64(cs->indexCount) * sizeof(unsigned int)));
+        const CacheLevelOfDetail* lods = reinterpret_cast<const CacheLevelOfDetail*>(
+                internals->cacheData(offset, qint64(cs->lodCount) * sizeof(CacheLevelOfDetail)));
+        const unsigned int* lodIndices = reinterpret_cast<const unsigned int*>(
+                internals->cacheData(offset, qint64(cs->lodIndexCount) * sizeof(unsigned int)));
+        Shape shape;
+        shape.materialIndex = cs->materialIndex;
+        for (quint32 j = 0; j < cs->lodCount; j++) {
+            LevelOfDetail lod;
+            lod.firstIndex = lods[j].firstIndex;
+            lod.indices = lods[j].indices;
+            // the clusters stay valid if the vertices are transformed, but the error scales
+            lod.error = lods[j].error * (retransform ? errorScale : 1.0f);
+            shape.levelsOfDetail.append(lod);
+        }
+        if (retransform) {
+            positionData.resize(cs->vertexCount * 3);
+            normalData.resize(cs->vertexCount * 3);
+            for (unsigned int j = 0; j < cs->vertexCount; j++) {
+                QVector3D p = matrix * QVector3D(positions[3 * j + 0], positions[3 * j + 1], positions[3 * j + 2]);
+                QVector3D n = normalMatrix * QVector3D(normals[3 * j + 0], normals[3 * j + 1], normals[3 * j + 2]);
+                for (int k = 0; k < 3; k++) {
+                    positionData[3 * j + k] = p[k];
+                    normalData[3 * j + k] = n[k];
+                }
+            }
+            positions = positionData.data();
+            normals = normalData.data();
+            shape.computeBoundingSphere(positions, cs->vertexCount);
+        } else {
+            shape.boundingSphereCenter = QVector3D(cs->boundingSphere[0], cs->boundingSphere[1], cs->boundingSphere[2]);
+            shape.boundingSphereRadius = cs->boundingSphere[3];
+        }
+        gl->glGenVertexArrays(1, &(shape.vao));
+        gl->glBindVertexArray(shape.vao);
+        GLuint positionBuffer;
+        gl->glGenBuffers(1, &positionBuffer);
+        gl->glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+        gl->glBufferData(GL_ARRAY_BUFFER, cs->vertexCount * 3 * sizeof(float), positions, GL_STATIC_DRAW);
+        gl->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        gl->glEnableVertexAttribArray(0);
+        GLuint normalBuffer;
+        gl->glGenBuffers(1, &normalBuffer);
+        gl->glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
+        gl->glBufferData(GL_ARRAY_BUFFER, cs->vertexCount * 3 * sizeof(float), normals, GL_STATIC_DRAW);
+        gl->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        gl->glEnableVertexAttribArray(1);
+        GLuint texcoordBuffer;
+        gl->glGenBuffers(1, &texcoordBuffer);
+        gl->glBindBuffer(GL_ARRAY_BUFFER, texcoordBuffer);
+        gl->glBufferData(GL_ARRAY_BUFFER, cs->vertexCount * 2 * sizeof(float), texcoords, GL_STATIC_DRAW);
+        gl->glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
+        gl->glEnableVertexAttribArray(2);
+        GLuint indexBuffer;
+        gl->glGenBuffers(1, &indexBuffer);
+        gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        shape.indices = cs->indexCount;
+        gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER, (qint64(cs->indexCount) + cs->lodIndexCount) * sizeof(unsigned int), nullptr, GL_STATIC_DRAW);
+        gl->glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, cs->indexCount * sizeof(unsigned int), indices);
+        gl->glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, cs->indexCount * sizeof(unsigned int),
+                cs->lodIndexCount * sizeof(unsigned int), lodIndices);
+        object.shapes.append(shape);
+    }
+    scene.objects.append(object);
+    scene.objectAnimations.append(Animation());
+}
+
 void Importer::addObjectToScene(Scene& scene) const
 {
+    if (_internals->cache) {
+        addCachedObjectToScene(_internals, _transformationMatrix, scene);
+        return;
+    }
 #ifdef HAVE_ASSIMP
     auto gl = getGlFunctionsFromCurrentContext(Q_FUNC_INFO);
+    bool writeCache = !_internals->cacheFileName.isEmpty();
 
-    /* first the materials */
+    /* CPU stage: decode all textures and prepare all meshes in parallel,
+     * using the global thread pool. Nothing here touches OpenGL. */
     QString baseDir = QFileInfo(_fileName).dir().path();
+    QVector<TextureRequest> textureRequests;
+    QMap<QString, int> textureRequestIndices;
+    for (unsigned int i = 0; i < _internals->scene->mNumMaterials; i++) {
+        const aiMaterial* m = _internals->scene->mMaterials[i];
+        for (int k = 0; k < 9; k++) {
+            if (m->GetTextureCount(importedTextureTypes[k]) > 0) {
+                TextureRequest tr;
+                tr.fileName = texFileName(baseDir, m, importedTextureTypes[k], 0, &tr.mapmode);
+                tr.scalar = importedTextureIsScalar[k];
+                if (!textureRequestIndices.contains(tr.fileName)) {
+                    textureRequestIndices.insert(tr.fileName, textureRequests.size());
+                    textureRequests.append(tr);
+                }
+            }
+        }
+    }
+    QVector<MeshData> meshData(_internals->scene->mNumMeshes);
+    QVector<int> meshIndices;
+    for (unsigned int i = 0; i < _internals->scene->mNumMeshes; i++) {
+        const aiMesh* m = _internals->scene->mMeshes[i];
+        if (!(m->mPrimitiveTypes & aiPrimitiveType_TRIANGLE)) {
+            qWarning("%s: ignoring shape %u because it is not triangle-based", qPrintable(_fileName), i);
+            continue;
+        }
+        if (m->mNumVertices > std::numeric_limits<unsigned int>::max()) {
+            qWarning("%s: ignoring shape %u because it has more vertices than I can handle", qPrintable(_fileName), i);
+            continue;
+        }
+        meshIndices.append(i);
+    }
+    QMatrix4x4 normalMatrix = QMatrix4x4(_transformationMatrix.normalMatrix());
+    const aiScene* aiscene = _internals->scene;
+    const QMatrix4x4& transformationMatrix = _transformationMatrix;
+    MeshData* meshDataPtr = meshData.data();
+    QFuture<void> textureFuture = QtConcurrent::map(textureRequests,
+            [](TextureRequest& tr) { tr.img = loadTexImage(tr.fileName); });
+    QFuture<void> meshFuture = QtConcurrent::map(meshIndices,
+            [&](const int& i) {
+                prepareMesh(aiscene->mMeshes[i], transformationMatrix, normalMatrix, meshDataPtr[i]);
+            });
+    textureFuture.waitForFinished();
+
+    /* GL stage: upload the textures and create the materials... */
     QMap<QString, unsigned int> texturemap;
+    for (int i = 0; i < textureRequests.size(); i++) {
+        const TextureRequest& tr = textureRequests[i];
+        unsigned int tex = 0;
+        if (tr.img.isNull())
+            qWarning("%s: cannot load texture, ignoring it", qPrintable(tr.fileName));
+        else
+            tex = uploadTex(tr.img, tr.mapmode, tr.scalar);
+        texturemap.insert(tr.fileName, tex);
+        textureRequests[i].img = QImage();
+    }
+    int firstMaterial = scene.materials.size();
     scene.materials.reserve(_internals->scene->mNumMaterials);
     for (unsigned int i = 0; i < _internals->scene->mNumMaterials; i++) {
         Material mat;
@@ -250,102 +862,167 @@ void Importer::addObjectToScene(Scene& scene) const
             mat.emissive = QVector3D(ctmp.r, ctmp.g, ctmp.b);
         if (m->Get(AI_MATKEY_SHININESS, ftmp) == aiReturn_SUCCESS)
             mat.shininess = ftmp;
-        if (m->GetTextureCount(aiTextureType_AMBIENT) > 0)
-            mat.ambientTex = createTex(baseDir, texturemap, m, aiTextureType_AMBIENT, 0, false);
-        if (m->GetTextureCount(aiTextureType_DIFFUSE) > 0)
-            mat.diffuseTex = createTex(baseDir, texturemap, m, aiTextureType_DIFFUSE, 0, false);
-        if (m->GetTextureCount(aiTextureType_SPECULAR) > 0)
-            mat.specularTex = createTex(baseDir, texturemap, m, aiTextureType_SPECULAR, 0, false);
-        if (m->GetTextureCount(aiTextureType_EMISSIVE) > 0)
-            mat.emissiveTex = createTex(baseDir, texturemap, m, aiTextureType_EMISSIVE, 0, false);
-        if (m->GetTextureCount(aiTextureType_SHININESS) > 0)
-            mat.shininessTex = createTex(baseDir, texturemap, m, aiTextureType_SHININESS, 0, true);
-        if (m->GetTextureCount(aiTextureType_LIGHTMAP) > 0)
-            mat.lightnessTex = createTex(baseDir, texturemap, m, aiTextureType_LIGHTMAP, 0, true);
-        if (m->GetTextureCount(aiTextureType_HEIGHT) > 0)
-            mat.bumpTex = createTex(baseDir, texturemap, m, aiTextureType_HEIGHT, 0, true);
-        if (m->GetTextureCount(aiTextureType_NORMALS) > 0)
-            mat.normalTex = createTex(baseDir, texturemap, m, aiTextureType_NORMALS, 0, false);
-        if (m->GetTextureCount(aiTextureType_OPACITY) > 0)
-            mat.opacityTex = createTex(baseDir, texturemap, m, aiTextureType_OPACITY, 0, true);
+        unsigned int tex[9];
+        for (int k = 0; k < 9; k++) {
+            tex[k] = 0;
+            if (m->GetTextureCount(importedTextureTypes[k]) > 0)
+                tex[k] = texturemap.value(texFileName(baseDir, m, importedTextureTypes[k], 0));
+        }
+        mat.ambientTex = tex[0];
+        mat.diffuseTex = tex[1];
+        mat.specularTex = tex[2];
+        mat.emissiveTex = tex[3];
+        mat.shininessTex = tex[4];
+        mat.lightnessTex = tex[5];
+        mat.bumpTex = tex[6];
+        mat.normalTex = tex[7];
+        mat.opacityTex = tex[8];
         scene.materials.append(mat);
     }
 
-    /* then the shapes */
-    QMatrix4x4 normalMatrix = QMatrix4x4(_transformationMatrix.normalMatrix());
-    std::vector<float> data;
+    /* ... and then the shapes */
+    meshFuture.waitForFinished();
+    QByteArray shapeCache;
     Object object;
-    object.shapes.reserve(_internals->scene->mNumMeshes);
-    for (unsigned int i = 0; i < _internals->scene->mNumMeshes; i++) {
-        Shape shape;
-        const aiMesh* m = _internals->scene->mMeshes[i];
-        if (!(m->mPrimitiveTypes & aiPrimitiveType_TRIANGLE)) {
-            qWarning("%s: ignoring shape %u because it is not triangle-based", qPrintable(_fileName), i);
-            continue;
-        }
-        if (m->mNumVertices > std::numeric_limits<unsigned int>::max()) {
-            qWarning("%s: ignoring shape %u because it has more vertices than I can handle", qPrintable(_fileName), i);
-            continue;
-        }
-        shape.materialIndex = m->mMaterialIndex;
+    object.shapes.reserve(meshIndices.size());
+    for (int i = 0; i < meshIndices.size(); i++) {
+        MeshData& md = meshData[meshIndices[i]];
+        Shape shape = md.shape;
+        unsigned int vertexCount = md.positions.size() / 3;
         gl->glGenVertexArrays(1, &(shape.vao));
         gl->glBindVertexArray(shape.vao);
         GLuint positionBuffer;
         gl->glGenBuffers(1, &positionBuffer);
         gl->glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
-        data.resize(m->mNumVertices * 3);
-        for (unsigned int j = 0; j < m->mNumVertices; j++) {
-            QVector3D v = QVector3D(m->mVertices[j].x, m->mVertices[j].y, m->mVertices[j].z);
-            QVector3D w = _transformationMatrix * v;
-            data[3 * j + 0] = w.x();
-            data[3 * j + 1] = w.y();
-            data[3 * j + 2] = w.z();
-        }
-        gl->glBufferData(GL_ARRAY_BUFFER, m->mNumVertices * 3 * sizeof(float), data.data(), GL_STATIC_DRAW);
+        gl->glBufferData(GL_ARRAY_BUFFER, md.positions.size() * sizeof(float), md.positions.data(), GL_STATIC_DRAW);
         gl->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
         gl->glEnableVertexAttribArray(0);
         GLuint normalBuffer;
         gl->glGenBuffers(1, &normalBuffer);
         gl->glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-        data.resize(m->mNumVertices * 3);
-        for (unsigned int j = 0; j < m->mNumVertices; j++) {
-            QVector3D v = QVector3D(m->mNormals[j].x, m->mNormals[j].y, m->mNormals[j].z);
-            QVector3D w = normalMatrix * v;
-            data[3 * j + 0] = w.x();
-            data[3 * j + 1] = w.y();
-            data[3 * j + 2] = w.z();
-        }
-        gl->glBufferData(GL_ARRAY_BUFFER, m->mNumVertices * 3 * sizeof(float), data.data(), GL_STATIC_DRAW);
+        gl->glBufferData(GL_ARRAY_BUFFER, md.normals.size() * sizeof(float), md.normals.data(), GL_STATIC_DRAW);
         gl->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
         gl->glEnableVertexAttribArray(1);
         GLuint texcoordBuffer;
         gl->glGenBuffers(1, &texcoordBuffer);
         gl->glBindBuffer(GL_ARRAY_BUFFER, texcoordBuffer);
-        data.resize(m->mNumVertices * 2, 0.0f);
-        if (m->mTextureCoords[0]) {
-            for (unsigned int j = 0; j < m->mNumVertices; j++) {
-                data[2 * j + 0] = m->mTextureCoords[0][j][0];
-                data[2 * j + 1] = m->mTextureCoords[0][j][1];
-            }
-        }
-        gl->glBufferData(GL_ARRAY_BUFFER, m->mNumVertices * 2 * sizeof(float), data.data(), GL_STATIC_DRAW);
+        gl->glBufferData(GL_ARRAY_BUFFER, md.texcoords.size() * sizeof(float), md.texcoords.data(), GL_STATIC_DRAW);
         gl->glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
         gl->glEnableVertexAttribArray(2);
         GLuint index_buffer;
         gl->glGenBuffers(1, &index_buffer);
         gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
-        std::vector<unsigned int> indices(m->mNumFaces * 3);
-        for (unsigned int j = 0; j < m->mNumFaces; j++) {
-            indices[3 * j + 0] = m->mFaces[j].mIndices[0];
-            indices[3 * j + 1] = m->mFaces[j].mIndices[1];
-            indices[3 * j + 2] = m->mFaces[j].mIndices[2];
-        }
-        gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
-        shape.indices = m->mNumFaces * 3;
+        gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER, (md.indices.size() + md.lodIndices.size()) * sizeof(unsigned int), nullptr, GL_STATIC_DRAW);
+        gl->glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, md.indices.size() * sizeof(unsigned int), md.indices.data());
+        gl->glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, md.indices.size() * sizeof(unsigned int),
+                md.lodIndices.size() * sizeof(unsigned int), md.lodIndices.constData());
         object.shapes.append(shape);
+        if (writeCache) {
+            CacheShape cs = { shape.materialIndex, vertexCount, shape.indices,
+                { shape.boundingSphereCenter.x(), shape.boundingSphereCenter.y(),
+                  shape.boundingSphereCenter.z(), shape.boundingSphereRadius },
+                quint32(shape.levelsOfDetail.size()), quint32(md.lodIndices.size()) };
+            appendToCache(shapeCache, &cs);
+            appendToCache(shapeCache, md.positions.data(), md.positions.size());
+            appendToCache(shapeCache, md.normals.data(), md.normals.size());
+            appendToCache(shapeCache, md.texcoords.data(), md.texcoords.size());
+            appendToCache(shapeCache, md.indices.data(), md.indices.size());
+            for (int j = 0; j < shape.levelsOfDetail.size(); j++) {
+                const LevelOfDetail& lod = shape.levelsOfDetail[j];
+                CacheLevelOfDetail cl = { lod.firstIndex, lod.indices, lod.error };
+                appendToCache(shapeCache, &cl);
+            }
+            appendToCache(shapeCache, md.lodIndices.constData(), md.lodIndices.size());
+        }
+        md = MeshData();
     }
     scene.objects.append(object);
     scene.objectAnimations.append(Animation());
+
+    /* finally write the import cache so that the next import of the same
+     * file can skip all of the above */
+    if (writeCache) {
+        QByteArray cache;
+        CacheHeader header;
+        std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+        std::memcpy(header.transformation, _transformationMatrix.constData(), 16 * sizeof(float));
+        QVector<unsigned int> textures;
+        for (auto it = texturemap.cbegin(); it != texturemap.cend(); ++it)
+            if (it.value() != 0 && !textures.contains(it.value()))
+                textures.append(it.value());
+        header.lightCount = _internals->scene->mNumLights;
+        header.textureCount = textures.size();
+        header.materialCount = scene.materials.size() - firstMaterial;
+        header.shapeCount = object.shapes.size();
+        QStringList dependencies = _internals->readFileNames;
+        dependencies.removeAll(QFileInfo(_fileName).absoluteFilePath()); // already part of the cache key
+        for (int i = 0; i < textureRequests.size(); i++) {
+            QString fileName = QFileInfo(textureRequests[i].fileName).absoluteFilePath();
+            if (!dependencies.contains(fileName))
+                dependencies.append(fileName);
+        }
+        header.dependencyCount = dependencies.size();
+        appendToCache(cache, &header);
+        for (int i = 0; i < dependencies.size(); i++) {
+            QByteArray name = dependencies[i].toUtf8();
+            CacheDependency cd;
+            getFileIdentity(dependencies[i], &cd.size, &cd.lastModified);
+            cd.nameSize = name.size();
+            cd.reserved = 0;
+            appendToCache(cache, &cd);
+            appendToCache(cache, name.constData(), name.size());
+        }
+        for (unsigned int i = 0; i < _internals->scene->mNumLights; i++) {
+            const aiLight* l = _internals->scene->mLights[i];
+            CacheLight cl;
+            cl.type = (l->mType == aiLightSource_DIRECTIONAL ? DirectionalLight
+                    : l->mType == aiLightSource_SPOT ? SpotLight : PointLight);
+            cl.innerConeAngle = l->mAngleInnerCone;
+            cl.outerConeAngle = l->mAngleOuterCone;
+            for (int k = 0; k < 3; k++) {
+                cl.position[k] = l->mPosition[k];
+                cl.direction[k] = l->mDirection[k];
+            }
+            cl.color[0] = l->mColorDiffuse.r;
+            cl.color[1] = l->mColorDiffuse.g;
+            cl.color[2] = l->mColorDiffuse.b;
+            cl.attenuation[0] = l->mAttenuationConstant;
+            cl.attenuation[1] = l->mAttenuationLinear;
+            cl.attenuation[2] = l->mAttenuationQuadratic;
+            appendToCache(cache, &cl);
+        }
+        for (int i = 0; i < textures.size(); i++)
+            appendTexToCache(cache, textures[i]);
+        for (int i = firstMaterial; i < scene.materials.size(); i++) {
+            const Material& mat = scene.materials[i];
+            const unsigned int tex[9] = { mat.ambientTex, mat.diffuseTex, mat.specularTex,
+                mat.emissiveTex, mat.shininessTex, mat.lightnessTex, mat.bumpTex, mat.normalTex,
+                mat.opacityTex };
+            CacheMaterial cm;
+            cm.isTwoSided = mat.isTwoSided;
+            cm.bumpScaling = mat.bumpScaling;
+            cm.opacity = mat.opacity;
+            for (int k = 0; k < 3; k++) {
+                cm.ambient[k] = mat.ambient[k];
+                cm.diffuse[k] = mat.diffuse[k];
+                cm.specular[k] = mat.specular[k];
+                cm.emissive[k] = mat.emissive[k];
+            }
+            cm.shininess = mat.shininess;
+            for (int k = 0; k < 9; k++)
+                cm.textures[k] = (tex[k] == 0 ? -1 : textures.indexOf(tex[k]));
+            appendToCache(cache, &cm);
+        }
+        cache.append(shapeCache);
+        QDir().mkpath(_cacheDirectory);
+        QSaveFile cacheFile(_internals->cacheFileName);
+        if (!cacheFile.open(QIODevice::WriteOnly)
+                || cacheFile.write(cache) != cache.size()
+                || !cacheFile.commit()) {
+            qWarning("%s: cannot write import cache %s", qPrintable(_fileName), qPrintable(_internals->cacheFileName));
+        }
+        _internals->cacheFileName = QString();
+    }
 #else
     Q_UNUSED(scene);
 #endif
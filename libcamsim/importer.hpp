@@ -39,6 +39,7 @@ class Importer
 private:
     ImporterInternals* _internals;
     QString _fileName;
+    QString _cacheDirectory;
     QMatrix4x4 _transformationMatrix;
 
 public:
@@ -59,6 +60,20 @@ public:
      */
     /*@{*/
 
+    /*! \brief Set a directory for the import cache, or an empty string to disable
+     * the cache (the default). This must be set before calling \a import().
+     *
+     * When the cache is enabled, the first call of \a addObjectToScene() after an
+     * import writes a binary bundle with the GPU-ready vertex data, indices, materials,
+     * mipmapped textures, and light sources. Subsequent imports of the same unchanged
+     * file map this bundle into memory instead of running libassimp.
+     * The bundle records the size and modification time of the other files that were
+     * read, such as material libraries and textures, and is not used if any of them changed. */
+    void setCacheDirectory(const QString& dir)
+    {
+        _cacheDirectory = dir;
+    }
+
     /*! \brief Import from the file with the given \a fileName */
     bool import(const QString& fileName);
 
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2018
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <cstdlib>
+
+#include <QDataStream>
+#include <QFile>
+#include <QFileInfo>
+#include <QProcess>
+
+#include "jobs.hpp"
+#include "exporter.hpp"
+
+namespace CamSim {
+
+SequenceJob::SequenceJob() :
+    index(0),
+    jobs(1),
+    firstFrame(0)
+{
+}
+
+QString SequenceJob::partFileName(const QString& fileName) const
+{
+    return JobSplitter::partFileName(fileName, index);
+}
+
+static const quint32 sequenceJobMagic = 0x43534A42; // "CSJB"
+static const quint32 sequenceJobVersion = 1;
+
+QByteArray SequenceJob::serialize() const
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << sequenceJobMagic << sequenceJobVersion
+        << qint32(index) << qint32(jobs) << qint32(firstFrame)
+        << qint32(frameTimestamps.size());
+    for (int i = 0; i < frameTimestamps.size(); i++)
+        stream << qint64(frameTimestamps[i]);
+    stream << state.serialize();
+    return data;
+}
+
+bool SequenceJob::deserialize(const QByteArray& data)
+{
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_6);
+    quint32 magic, version;
+    qint32 idx, n, first, frames;
+    stream >> magic >> version >> idx >> n >> first >> frames;
+    if (stream.status() != QDataStream::Ok || magic != sequenceJobMagic || version != sequenceJobVersion
+            || frames < 0)
+        return false;
+    QVector<long long> timestamps(frames);
+    for (int i = 0; i < frames; i++) {
+        qint64 t;
+        stream >> t;
+        timestamps[i] = t;
+    }
+    QByteArray stateData;
+    stream >> stateData;
+    SimulatorState s;
+    if (stream.status() != QDataStream::Ok || !s.deserialize(stateData))
+        return false;
+    index = idx;
+    jobs = n;
+    firstFrame = first;
+    frameTimestamps = timestamps;
+    state = s;
+    return true;
+}
+
+QVector<long long> JobSplitter::sequenceTimestamps(Simulator& simulator)
+{
+    QVector<long long> timestamps;
+    long long start = simulator.startTimestamp();
+    long long end = simulator.endTimestamp();
+    long long duration = simulator.frameDuration();
+    for (long long t = start; t < end; t += duration)
+        timestamps.append(t);
+    if (timestamps.isEmpty()) // static scene: a single frame
+        timestamps.append(start);
+    return timestamps;
+}
+
+QList<SequenceJob> JobSplitter::split(Simulator& simulator, int jobs)
+{
+    QList<SequenceJob> list;
+    QVector<long long> timestamps = sequenceTimestamps(simulator);
+    for (int i = 0; i < jobs; i++) {
+        SequenceJob job;
+        job.index = i;
+        job.jobs = jobs;
+        job.firstFrame = i * timestamps.size() / jobs;
+        int endFrame = (i + 1) * timestamps.size() / jobs;
+        job.frameTimestamps = timestamps.mid(job.firstFrame, endFrame - job.firstFrame);
+        job.state.randomSeed = simulator.randomSeed();
+        job.state.haveLastFrame = (job.firstFrame > 0);
+        job.state.lastFrameTimestamp = (job.firstFrame > 0 ? timestamps[job.firstFrame - 1] : 0);
+        list.append(job);
+    }
+    return list;
+}
+
+SequenceJob JobSplitter::job(Simulator& simulator, int index, int jobs)
+{
+    if (jobs < 1 || index < 0 || index >= jobs) {
+        qCritical("Invalid job %d of %d", index, jobs);
+        std::exit(1);
+    }
+    return split(simulator, jobs)[index];
+}
+
+QString JobSplitter::partFileName(const QString& fileName, int index)
+{
+    QFileInfo fileInfo(fileName);
+    QString suffix = fileInfo.completeSuffix();
+    QString base = fileName.left(fileName.length() - (suffix.isEmpty() ? 0 : suffix.length() + 1));
+    return base + QString::asprintf("-job%04d", index) + (suffix.isEmpty() ? QString() : '.' + suffix);
+}
+
+static bool appendFile(const QString& fileName, QFile& target)
+{
+    QFile part(fileName);
+    if (!part.open(QIODevice::ReadOnly)) {
+        qCritical("%s: cannot open for reading", qPrintable(fileName));
+        return false;
+    }
+    const qint64 blockSize = 1 << 20;
+    while (!part.atEnd()) {
+        QByteArray block = part.read(blockSize);
+        if (block.isEmpty() || target.write(block) != block.size()) {
+            qCritical("%s: cannot copy data from %s", qPrintable(target.fileName()), qPrintable(fileName));
+            return false;
+        }
+    }
+    return true;
+}
+
+bool JobSplitter::merge(const QString& fileName, int jobs, bool removeParts)
+{
+    FileFormat format = Exporter::fileFormatFromName(fileName);
+    if (format != FileFormat_RAW && format != FileFormat_PNM
+            && format != FileFormat_PFS && format != FileFormat_GTA) {
+        qCritical("%s: file format cannot be merged", qPrintable(fileName));
+        return false;
+    }
+    // RAW files have a separate header file that needs to be merged, too
+    QStringList fileNames = { fileName };
+    if (format == FileFormat_RAW)
+        fileNames.append(fileName + "_header");
+
+    for (int f = 0; f < fileNames.size(); f++) {
+        QFile target(fileNames[f]);
+        if (!target.open(QIODevice::WriteOnly)) {
+            qCritical("%s: cannot open for writing", qPrintable(fileNames[f]));
+            return false;
+        }
+        for (int i = 0; i < jobs; i++) {
+            // the header of RAW part files has the name of the part plus "_header"
+            QString part = (f == 0 ? partFileName(fileName, i) : partFileName(fileName, i) + "_header");
+            if (!appendFile(part, target))
+                return false;
+        }
+        if (!target.flush()) {
+            qCritical("%s: write error", qPrintable(fileNames[f]));
+            return false;
+        }
+    }
+    if (removeParts) {
+        for (int i = 0; i < jobs; i++) {
+            QFile::remove(partFileName(fileName, i));
+            if (format == FileFormat_RAW)
+                QFile::remove(partFileName(fileName, i) + "_header");
+        }
+    }
+    return true;
+}
+
+bool JobSplitter::runProcesses(const QString& program, const QStringList& arguments, int jobs)
+{
+    QList<QProcess*> processes;
+    bool ok = true;
+    for (int i = 0; i < jobs; i++) {
+        QStringList args;
+        for (int j = 0; j < arguments.size(); j++) {
+            QString arg = arguments[j];
+            arg.replace("{jobs}", QString::number(jobs));
+            arg.replace("{job}", QString::number(i));
+            args.append(arg);
+        }
+        QProcess* process = new QProcess;
+        process->setProcessChannelMode(QProcess::ForwardedChannels);
+        process->start(program, args);
+        processes.append(process);
+    }
+    for (int i = 0; i < processes.size(); i++) {
+        if (!processes[i]->waitForFinished(-1)
+                || processes[i]->exitStatus() != QProcess::NormalExit
+                || processes[i]->exitCode() != 0) {
+            qCritical("%s: job %d failed", qPrintable(program), i);
+            ok = false;
+        }
+        delete processes[i];
+    }
+    return ok;
+}
+
+}
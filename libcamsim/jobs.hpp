@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2018
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CAMSIM_JOBS_HPP
+#define CAMSIM_JOBS_HPP
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "simulator.hpp"
+
+namespace CamSim {
+
+/**
+ * \brief A part of a sequence that can be simulated independently, see \a JobSplitter
+ */
+class SequenceJob
+{
+public:
+    /*! \brief Constructor */
+    SequenceJob();
+
+    /*! \brief Index of this job */
+    int index;
+    /*! \brief Number of jobs that the sequence was split into */
+    int jobs;
+    /*! \brief Index of the first frame of this job in the sequence */
+    int firstFrame;
+    /*! \brief Timestamps of the frames of this job */
+    QVector<long long> frameTimestamps;
+    /*! \brief Simulator state before the first frame of this job; pass it to
+     * \a Simulator::setState() before simulating the frames */
+    SimulatorState state;
+
+    /*! \brief Return the name of the file that this job should write
+     * instead of \a fileName, so that \a JobSplitter::merge() can find it */
+    QString partFileName(const QString& fileName) const;
+
+    /*! \brief Return the job in a compact binary representation, e.g. to send it to a node */
+    QByteArray serialize() const;
+    /*! \brief Set the job from the binary representation created by \a serialize().
+     * Returns false if the data is invalid. */
+    bool deserialize(const QByteArray& data);
+};
+
+/**
+ * \brief Splits sequences into jobs for distributed simulation and merges the results
+ *
+ * A sequence is split into contiguous parts of nearly equal length. Each part
+ * can be simulated by a separate process or cluster node with the same
+ * simulator configuration, since the job contains the simulator state that
+ * the part starts with (see \a SimulatorState). Each job writes its results
+ * to its own part files (see \a SequenceJob::partFileName()), which are then
+ * concatenated by \a merge().
+ *
+ * Example for a job on a cluster node:
+ * \code
+ * // configure simulator as for the complete sequence
+ * CamSim::SequenceJob job = CamSim::JobSplitter::job(simulator, jobIndex, jobCount);
+ * simulator.setState(job.state);
+ * CamSim::SequenceWriter writer(job.partFileName("pmd.pfs"));
+ * simulator.simulateBatch(job.frameTimestamps,
+ *         [&](int, long long) { return QList<CamSim::TexDataFuture>() << simulator.getPMDAsync(); },
+ *         [&](int, long long, const QList<CamSim::TexData>& results) { writer.append(results[0]); });
+ * writer.finish();
+ * // when all jobs are done:
+ * CamSim::JobSplitter::merge("pmd.pfs", jobCount);
+ * \endcode
+ */
+class JobSplitter
+{
+public:
+    /*! \brief Return the timestamps of all frames of the sequence configured in \a simulator,
+     * from \a Simulator::startTimestamp() to \a Simulator::endTimestamp() */
+    static QVector<long long> sequenceTimestamps(Simulator& simulator);
+
+    /*! \brief Split the sequence configured in \a simulator into \a jobs jobs */
+    static QList<SequenceJob> split(Simulator& simulator, int jobs);
+
+    /*! \brief Return job \a index of the \a jobs jobs that the sequence configured in
+     * \a simulator is split into. This is the same as split(simulator, jobs)[index],
+     * so each node can determine its job on its own. */
+    static SequenceJob job(Simulator& simulator, int index, int jobs);
+
+    /*! \brief Return the name of the part of \a fileName written by job \a index,
+     * e.g. "pmd-job0003.pfs" for "pmd.pfs" */
+    static QString partFileName(const QString& fileName, int index);
+
+    /*! \brief Concatenate the parts of \a fileName written by \a jobs jobs into
+     * \a fileName, and remove the parts if \a removeParts is set. This works for the
+     * file formats that \a SequenceWriter can append to as streams: RAW, PNM, PFS,
+     * and GTA. Returns false on error. */
+    static bool merge(const QString& fileName, int jobs, bool removeParts = true);
+
+    /*! \brief Run \a jobs local processes of \a program with the given \a arguments,
+     * in which the strings "{job}" and "{jobs}" are replaced by the job index and
+     * the number of jobs, and wait for all of them. Returns false if a process
+     * could not be started or failed. */
+    static bool runProcesses(const QString& program, const QStringList& arguments, int jobs);
+};
+
+}
+
+#endif
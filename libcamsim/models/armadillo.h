@@ -1,9 +0,0 @@
-#ifndef ARMADILLO_H
-#define ARMADILLO_H
-extern const unsigned long armadillo_vertexcount;
-extern const unsigned long armadillo_indexcount;
-extern const float armadillo_positions[];
-extern const float armadillo_normals[];
-extern const float armadillo_texcoords[];
-extern const unsigned int armadillo_indices[];
-#endif